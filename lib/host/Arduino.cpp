@@ -0,0 +1,133 @@
+#include "Arduino.h"
+
+#include <malloc.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static std::chrono::steady_clock::time_point bootTime =
+    std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void hostRestartClock() { bootTime = std::chrono::steady_clock::now(); }
+
+long random(long howbig) { return howbig > 0 ? ::random() % howbig : 0; }
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) { srandom(seed); }
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t copied = length < size - 1 ? length : size - 1;
+    memcpy(dst, src, copied);
+    dst[copied] = 0;
+  }
+  return length;
+}
+#endif
+
+// *************************
+// ** Serial **
+// *************************
+
+size_t HardwareSerial::print(const char *text) {
+  return fputs(text, stdout) < 0 ? 0 : strlen(text);
+}
+
+size_t HardwareSerial::print(char c) { return putchar(c) == EOF ? 0 : 1; }
+
+size_t HardwareSerial::print(long value) { return ::printf("%ld", value); }
+
+size_t HardwareSerial::print(unsigned long value) {
+  return ::printf("%lu", value);
+}
+
+size_t HardwareSerial::print(double value) { return ::printf("%.2f", value); }
+
+size_t HardwareSerial::printf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vprintf(format, args);
+  va_end(args);
+  return written < 0 ? 0 : written;
+}
+
+// *************************
+// ** Heap **
+// *************************
+
+static std::atomic<uint32_t> minFreeHeap(HOST_HEAP_SIZE);
+
+uint32_t EspClass::getFreeHeap() {
+  size_t used = mallinfo2().uordblks;
+  uint32_t free = used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+  uint32_t lowest = minFreeHeap.load();
+  while (free < lowest && !minFreeHeap.compare_exchange_weak(lowest, free)) {
+  }
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return minFreeHeap.load();
+}
+
+// *************************
+// ** FreeRTOS **
+// *************************
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::timed_mutex(); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  std::timed_mutex *mutex = static_cast<std::timed_mutex *>(semaphore);
+  if (ticks == portMAX_DELAY) {
+    mutex->lock();
+    return pdTRUE;
+  }
+  return mutex->try_lock_for(
+             std::chrono::milliseconds(ticks * portTICK_PERIOD_MS))
+             ? pdTRUE
+             : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  static_cast<std::timed_mutex *>(semaphore)->unlock();
+  return pdTRUE;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stackSize, void *parameter,
+                       unsigned int priority, TaskHandle_t *handle) {
+  std::thread(task, parameter).detach();
+  if (handle) *handle = NULL;
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks * portTICK_PERIOD_MS); }
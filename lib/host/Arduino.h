@@ -0,0 +1,115 @@
+#pragma once
+
+// *************************
+// ** Host Arduino Core **
+// *************************
+// The part of the ESP32 Arduino core the firmware uses, on Linux. Time starts
+// at 0 like after a reset, tasks are threads and mutexes are std::mutex.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "IPAddress.h"
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+
+// Restarts millis() and micros() at 0, as after a reset. Lets a forked test
+// process act as a freshly booted node.
+void hostRestartClock();
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// glibc has strlcpy since 2.38
+#if defined(__GLIBC__) && \
+    (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) {}
+  size_t print(const char *text);
+  size_t print(const String &text) { return print(text.c_str()); }
+  size_t print(const IPAddress &ip) { return print(ip.toString()); }
+  size_t print(char c);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t print(double value);
+  template <typename T>
+  size_t println(const T &value) {
+    return print(value) + println();
+  }
+  size_t println() { return print('\n'); }
+  size_t printf(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+// Heap of the process, reported as if it had the size of the ESP32 heap so the
+// numbers read like the ones on the device
+#define HOST_HEAP_SIZE 327680
+
+class EspClass {
+ public:
+  uint32_t getHeapSize() { return HOST_HEAP_SIZE; }
+  uint32_t getFreeHeap();
+  // Lowest getFreeHeap() seen so far, the host does not track every allocation
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+};
+
+extern EspClass ESP;
+
+// *************************
+// ** FreeRTOS **
+// *************************
+
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+// Starts a detached thread, stack size and priority are ignored
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stackSize, void *parameter,
+                       unsigned int priority, TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+
+// The firmware entry points, called by the host main
+void setup();
+void loop();
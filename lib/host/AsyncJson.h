@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+// *************************
+// ** Host JSON Handler **
+// *************************
+// Same matching as AsyncCallbackJsonWebHandler: POST, PUT or PATCH with an
+// application/json body on uri or below it. The body is parsed into a
+// document of maxJsonBufferSize bytes, a body that does not parse or fit is
+// answered with 400.
+
+#define DYNAMIC_JSON_DOCUMENT_SIZE 1024
+
+typedef std::function<void(AsyncWebServerRequest *request, JsonVariant &json)>
+    ArJsonRequestHandlerFunction;
+
+class AsyncCallbackJsonWebHandler : public AsyncWebHandler {
+ public:
+  AsyncCallbackJsonWebHandler(
+      const String &uri, ArJsonRequestHandlerFunction onRequest,
+      size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE)
+      : uri(uri),
+        method(HTTP_POST | HTTP_PUT | HTTP_PATCH),
+        onRequest(onRequest),
+        maxJsonBufferSize(maxJsonBufferSize) {}
+
+  void setMethod(WebRequestMethodComposite methods) { method = methods; }
+
+  bool canHandle(AsyncWebServerRequest *request) override {
+    if (!onRequest || !(method & request->method())) return false;
+    if (uri.length() && uri != request->url() &&
+        !request->url().startsWith(uri + "/"))
+      return false;
+    return request->contentType().equalsIgnoreCase("application/json");
+  }
+
+  void handleRequest(AsyncWebServerRequest *request) override {
+    DynamicJsonDocument document(maxJsonBufferSize);
+    // Parsed from a copy, like the device parses its mutable body buffer
+    String body = request->body();
+    DeserializationError error =
+        deserializeJson(document, (char *)body.c_str());
+    if (error) {
+      request->send(400);
+      return;
+    }
+    JsonVariant json = document.as<JsonVariant>();
+    onRequest(request, json);
+  }
+
+ private:
+  String uri;
+  WebRequestMethodComposite method;
+  ArJsonRequestHandlerFunction onRequest;
+  size_t maxJsonBufferSize;
+};
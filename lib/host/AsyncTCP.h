@@ -0,0 +1,3 @@
+#pragma once
+
+// The web server stand-in works on plain sockets, nothing to declare here
@@ -0,0 +1,77 @@
+#include "AsyncUDP.h"
+
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+
+static sockaddr_in socketAddress(const IPAddress &ip, uint16_t port) {
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr =
+      htonl(((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) |
+            ((uint32_t)ip[2] << 8) | ip[3]);
+  return address;
+}
+
+bool AsyncUDP::listen(uint16_t port) {
+  close();
+  socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket < 0) return false;
+
+  int reuse = 1;
+  setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = socketAddress(WiFi.localIP(), port);
+  if (bind(socket, (sockaddr *)&address, sizeof(address)) < 0) {
+    close();
+    return false;
+  }
+  std::thread(&AsyncUDP::receive, this).detach();
+  return true;
+}
+
+void AsyncUDP::receive() {
+  uint8_t buffer[1500];
+  int own = socket;
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    ssize_t length = recvfrom(own, buffer, sizeof(buffer), 0,
+                              (sockaddr *)&from, &fromLength);
+    if (length < 0) return;  // closed
+
+    uint32_t ip = ntohl(from.sin_addr.s_addr);
+    AsyncUDPPacket packet(buffer, length,
+                          IPAddress(ip >> 24, ip >> 16, ip >> 8, ip),
+                          ntohs(from.sin_port));
+    if (handler) handler(packet);
+  }
+}
+
+size_t AsyncUDP::writeTo(const uint8_t *data, size_t length,
+                         const IPAddress &ip, uint16_t port) {
+  if (socket < 0) return 0;
+  sockaddr_in address = socketAddress(ip, port);
+  ssize_t sent =
+      sendto(socket, data, length, 0, (sockaddr *)&address, sizeof(address));
+  return sent < 0 ? 0 : sent;
+}
+
+size_t AsyncUDP::broadcastTo(uint8_t *data, size_t length, uint16_t port) {
+  size_t sent = 0;
+  for (uint8_t node = 1; node <= HOST_UDP_NODES; node++) {
+    sent = max(sent, writeTo(data, length, IPAddress(127, 0, 0, node), port));
+  }
+  return sent;
+}
+
+void AsyncUDP::close() {
+  if (socket < 0) return;
+  shutdown(socket, SHUT_RDWR);
+  ::close(socket);
+  socket = -1;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+
+// *************************
+// ** Host AsyncUDP **
+// *************************
+// A UDP socket bound to WiFi.localIP(), callbacks run on a receive thread
+// like on the AsyncUDP task. Loopback has no broadcast, broadcastTo() sends
+// to 127.0.0.1 up to 127.0.0.HOST_UDP_NODES instead.
+
+#define HOST_UDP_NODES 16
+
+class AsyncUDPPacket {
+ public:
+  AsyncUDPPacket(uint8_t *data, size_t length, IPAddress remoteIP,
+                 uint16_t remotePort)
+      : packetData(data),
+        packetLength(length),
+        remote(remoteIP),
+        port(remotePort) {}
+
+  uint8_t *data() { return packetData; }
+  size_t length() { return packetLength; }
+  IPAddress remoteIP() { return remote; }
+  uint16_t remotePort() { return port; }
+
+ private:
+  uint8_t *packetData;
+  size_t packetLength;
+  IPAddress remote;
+  uint16_t port;
+};
+
+typedef std::function<void(AsyncUDPPacket &packet)> AuPacketHandlerFunction;
+
+class AsyncUDP {
+ public:
+  ~AsyncUDP() { close(); }
+
+  bool listen(uint16_t port);
+  void onPacket(AuPacketHandlerFunction callback) { handler = callback; }
+  size_t writeTo(const uint8_t *data, size_t length, const IPAddress &address,
+                 uint16_t port);
+  size_t broadcastTo(uint8_t *data, size_t length, uint16_t port);
+  void close();
+  bool connected() { return socket >= 0; }
+
+ private:
+  void receive();
+
+  int socket = -1;
+  AuPacketHandlerFunction handler;
+};
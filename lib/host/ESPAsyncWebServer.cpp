@@ -0,0 +1,196 @@
+#include "ESPAsyncWebServer.h"
+
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#define HOST_MAX_HEADER 8192
+#define HOST_MAX_BODY 16384
+
+static const char *statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    default: return "";
+  }
+}
+
+static WebRequestMethodComposite parseMethod(const std::string &name) {
+  if (name == "GET") return HTTP_GET;
+  if (name == "POST") return HTTP_POST;
+  if (name == "DELETE") return HTTP_DELETE;
+  if (name == "PUT") return HTTP_PUT;
+  if (name == "PATCH") return HTTP_PATCH;
+  if (name == "HEAD") return HTTP_HEAD;
+  if (name == "OPTIONS") return HTTP_OPTIONS;
+  return 0;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType,
+                                 const String &content) {
+  if (response.length()) return;  // the first response wins
+
+  char status[64];
+  snprintf(status, sizeof(status), "HTTP/1.1 %d %s\r\n", code,
+           statusText(code));
+  response = status;
+  for (const auto &header : DefaultHeaders::Instance().headers) {
+    response += header.first + ": " + header.second + "\r\n";
+  }
+  if (contentType.length()) {
+    response += String("Content-Type: ") + contentType + "\r\n";
+  }
+  response += String("Content-Length: ") + String(content.length()) + "\r\n";
+  response += "Connection: close\r\n\r\n";
+  response += content;
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) {
+  if (!onRequest || !(method & request->method())) return false;
+  return uri == request->url() || request->url().startsWith(uri + "/");
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest *request) {
+  onRequest(request);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(
+    const char *uri, WebRequestMethodComposite method,
+    ArRequestHandlerFunction onRequest) {
+  AsyncCallbackWebHandler *handler =
+      new AsyncCallbackWebHandler(uri, method, onRequest);
+  handlers.push_back(handler);
+  return *handler;
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler) {
+  handlers.push_back(handler);
+  return *handler;
+}
+
+void AsyncWebServer::begin() {
+  const char *override = getenv("HOST_HTTP_PORT");
+  if (override) port = atoi(override);
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 ||
+      ::listen(listener, 64) < 0) {
+    Serial.printf("web server can not listen on port %u\n", port);
+    end();
+    return;
+  }
+  std::thread(&AsyncWebServer::serve, this).detach();
+}
+
+void AsyncWebServer::end() {
+  if (listener < 0) return;
+  shutdown(listener, SHUT_RDWR);
+  close(listener);
+  listener = -1;
+}
+
+void AsyncWebServer::serve() {
+  int own = listener;
+  for (;;) {
+    int client = accept(own, NULL, NULL);
+    if (client < 0) return;  // ended
+    answer(client);
+    close(client);
+  }
+}
+
+static bool sendAll(int client, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = ::send(client, data, length, MSG_NOSIGNAL);
+    if (sent <= 0) return false;
+    data += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+void AsyncWebServer::answer(int client) {
+  // Headers, then as much body as Content-Length asks for
+  std::string data;
+  size_t headerEnd;
+  char buffer[2048];
+  while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+    if (data.length() > HOST_MAX_HEADER) return;
+    ssize_t length = recv(client, buffer, sizeof(buffer), 0);
+    if (length <= 0) return;
+    data.append(buffer, length);
+  }
+
+  AsyncWebServerRequest request;
+  size_t lineEnd = data.find("\r\n");
+  std::string line = data.substr(0, lineEnd);
+  size_t methodEnd = line.find(' ');
+  size_t urlEnd = line.find(' ', methodEnd + 1);
+  if (methodEnd == std::string::npos || urlEnd == std::string::npos) return;
+  request.requestMethod = parseMethod(line.substr(0, methodEnd));
+  std::string url = line.substr(methodEnd + 1, urlEnd - methodEnd - 1);
+  request.requestUrl = url.substr(0, url.find('?')).c_str();
+
+  size_t bodyLength = 0;
+  size_t position = lineEnd + 2;
+  while (position < headerEnd) {
+    size_t next = data.find("\r\n", position);
+    std::string header = data.substr(position, next - position);
+    position = next + 2;
+    size_t colon = header.find(':');
+    if (colon == std::string::npos) continue;
+    String name = header.substr(0, colon).c_str();
+    String value = header.substr(colon + 1).c_str();
+    value.trim();
+    if (name.equalsIgnoreCase("Content-Length")) bodyLength = value.toInt();
+    if (name.equalsIgnoreCase("Content-Type")) {
+      request.requestContentType = value;
+    }
+  }
+
+  if (bodyLength > HOST_MAX_BODY) {
+    request.send(413);
+  } else {
+    std::string body = data.substr(headerEnd + 4);
+    while (body.length() < bodyLength) {
+      ssize_t length = recv(client, buffer, sizeof(buffer), 0);
+      if (length <= 0) return;
+      body.append(buffer, length);
+    }
+    request.requestBody = body.substr(0, bodyLength).c_str();
+
+    AsyncWebHandler *match = NULL;
+    for (AsyncWebHandler *handler : handlers) {
+      if (handler->canHandle(&request)) {
+        match = handler;
+        break;
+      }
+    }
+    if (match) {
+      match->handleRequest(&request);
+    } else if (notFound) {
+      notFound(&request);
+    } else {
+      request.send(500);  // what the device answers without onNotFound
+    }
+    if (!request.response.length()) {
+      request.send(500, "text/plain", "handler sent no response");
+    }
+  }
+  sendAll(client, request.response.c_str(), request.response.length());
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// *************************
+// ** Host Web Server **
+// *************************
+// ESPAsyncWebServer on a real socket. One thread accepts and answers the
+// connections one after the other, like the single AsyncTCP task, so
+// handlers see the same concurrency as on the device. Handlers are matched
+// in the order they were added, with the same uri rules. The port can be
+// moved with the HOST_HTTP_PORT environment variable.
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest {
+ public:
+  WebRequestMethodComposite method() const { return requestMethod; }
+  const String &url() const { return requestUrl; }
+  const String &contentType() const { return requestContentType; }
+  size_t contentLength() const { return requestBody.length(); }
+
+  void send(int code, const String &contentType = String(),
+            const String &content = String());
+
+  // Host only, the request body the JSON handler parses
+  const String &body() const { return requestBody; }
+
+ private:
+  friend class AsyncWebServer;
+
+  WebRequestMethodComposite requestMethod = 0;
+  String requestUrl;
+  String requestContentType;
+  String requestBody;
+  String response;  // empty until send()
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)>
+    ArRequestHandlerFunction;
+
+class AsyncWebHandler {
+ public:
+  virtual ~AsyncWebHandler() {}
+  virtual bool canHandle(AsyncWebServerRequest *request) { return false; }
+  virtual void handleRequest(AsyncWebServerRequest *request) {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+ public:
+  AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method,
+                          ArRequestHandlerFunction onRequest)
+      : uri(uri), method(method), onRequest(onRequest) {}
+
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+
+ private:
+  String uri;
+  WebRequestMethodComposite method;
+  ArRequestHandlerFunction onRequest;
+};
+
+class AsyncWebServer {
+ public:
+  AsyncWebServer(uint16_t port) : port(port) {}
+  ~AsyncWebServer() { end(); }
+
+  void begin();
+  void end();
+
+  AsyncCallbackWebHandler &on(const char *uri,
+                              WebRequestMethodComposite method,
+                              ArRequestHandlerFunction onRequest);
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+  void onNotFound(ArRequestHandlerFunction onRequest) { notFound = onRequest; }
+
+ private:
+  void serve();
+  void answer(int client);
+
+  uint16_t port;
+  int listener = -1;
+  std::vector<AsyncWebHandler *> handlers;
+  ArRequestHandlerFunction notFound;
+};
+
+class DefaultHeaders {
+ public:
+  static DefaultHeaders &Instance() {
+    static DefaultHeaders instance;
+    return instance;
+  }
+
+  void addHeader(const String &name, const String &value) {
+    headers.push_back(std::make_pair(name, value));
+  }
+
+  std::vector<std::pair<String, String>> headers;
+};
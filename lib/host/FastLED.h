@@ -0,0 +1,187 @@
+#pragma once
+
+#include <Arduino.h>
+
+// *************************
+// ** Host FastLED **
+// *************************
+// The FastLED subset the effects use, with the same 8 bit math. show() does
+// not drive a strip, it only counts frames.
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  uint16_t t = i + j;
+  return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) { return i > j ? i - j : 0; }
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+  uint16_t partial = (a << 8) | b;
+  partial -= a * amountOfB;
+  partial += b * amountOfB;
+  return partial >> 8;
+}
+
+uint8_t sin8(uint8_t theta);
+inline uint8_t cos8(uint8_t theta) { return sin8(theta + 64); }
+
+inline uint8_t triwave8(uint8_t in) {
+  if (in & 0x80) in = 255 - in;
+  return in << 1;
+}
+
+uint8_t random8();
+inline uint8_t random8(uint8_t lim) { return (random8() * lim) >> 8; }
+inline uint8_t random8(uint8_t min, uint8_t lim) {
+  return random8(lim - min) + min;
+}
+uint16_t random16();
+inline uint16_t random16(uint16_t lim) {
+  return ((uint32_t)random16() * lim) >> 16;
+}
+
+struct CRGB {
+  union {
+    struct {
+      union {
+        uint8_t r;
+        uint8_t red;
+      };
+      union {
+        uint8_t g;
+        uint8_t green;
+      };
+      union {
+        uint8_t b;
+        uint8_t blue;
+      };
+    };
+    uint8_t raw[3];
+  };
+
+  typedef enum {
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    Red = 0xFF0000,
+    White = 0xFFFFFF
+  } HTMLColorCode;
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+  CRGB(uint32_t colorcode)
+      : r((colorcode >> 16) & 0xff),
+        g((colorcode >> 8) & 0xff),
+        b(colorcode & 0xff) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+
+  CRGB &nscale8(uint8_t scale) {
+    r = scale8(r, scale);
+    g = scale8(g, scale);
+    b = scale8(b, scale);
+    return *this;
+  }
+  CRGB &fadeToBlackBy(uint8_t fadefactor) { return nscale8(255 - fadefactor); }
+  CRGB &operator%=(uint8_t scale) { return nscale8(scale); }
+  CRGB &operator+=(const CRGB &rhs) {
+    r = qadd8(r, rhs.r);
+    g = qadd8(g, rhs.g);
+    b = qadd8(b, rhs.b);
+    return *this;
+  }
+  explicit operator bool() const { return r || g || b; }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs) {
+  return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs) {
+  return !(lhs == rhs);
+}
+
+CRGB &nblend(CRGB &existing, const CRGB &overlay, fract8 amountOfOverlay);
+CRGB blend(const CRGB &p1, const CRGB &p2, fract8 amountOfP2);
+void fill_solid(CRGB *leds, int numToFill, const CRGB &color);
+
+typedef uint32_t TProgmemRGBPalette16[16];
+
+extern const TProgmemRGBPalette16 CloudColors_p;
+extern const TProgmemRGBPalette16 LavaColors_p;
+extern const TProgmemRGBPalette16 OceanColors_p;
+extern const TProgmemRGBPalette16 ForestColors_p;
+extern const TProgmemRGBPalette16 RainbowColors_p;
+extern const TProgmemRGBPalette16 RainbowStripeColors_p;
+extern const TProgmemRGBPalette16 PartyColors_p;
+extern const TProgmemRGBPalette16 HeatColors_p;
+
+class CRGBPalette16 {
+ public:
+  CRGB entries[16];
+
+  CRGBPalette16() {}
+  CRGBPalette16(const CRGB &c) {
+    for (CRGB &entry : entries) entry = c;
+  }
+  CRGBPalette16(const TProgmemRGBPalette16 &rhs) {
+    for (int i = 0; i < 16; i++) entries[i] = CRGB(rhs[i]);
+  }
+  CRGBPalette16(const CRGB &c00, const CRGB &c01, const CRGB &c02,
+                const CRGB &c03, const CRGB &c04, const CRGB &c05,
+                const CRGB &c06, const CRGB &c07, const CRGB &c08,
+                const CRGB &c09, const CRGB &c10, const CRGB &c11,
+                const CRGB &c12, const CRGB &c13, const CRGB &c14,
+                const CRGB &c15)
+      : entries{c00, c01, c02, c03, c04, c05, c06, c07,
+                c08, c09, c10, c11, c12, c13, c14, c15} {}
+
+  CRGB &operator[](uint8_t x) { return entries[x]; }
+  const CRGB &operator[](uint8_t x) const { return entries[x]; }
+
+  bool operator==(const CRGBPalette16 &rhs) const {
+    return memcmp(entries, rhs.entries, sizeof(entries)) == 0;
+  }
+  bool operator!=(const CRGBPalette16 &rhs) const { return !(*this == rhs); }
+};
+
+typedef enum { NOBLEND = 0, LINEARBLEND = 1 } TBlendType;
+
+CRGB ColorFromPalette(const CRGBPalette16 &pal, uint8_t index,
+                      uint8_t brightness = 255,
+                      TBlendType blendType = LINEARBLEND);
+
+// *************************
+// ** Controller **
+// *************************
+
+typedef enum { RGB = 0012, GRB = 0102 } EOrder;
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER>
+class WS2811 {};
+
+class CFastLED {
+ public:
+  template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET,
+            uint8_t DATA_PIN, EOrder RGB_ORDER>
+  void addLeds(CRGB *data, int count) {
+    leds = data;
+    ledCount = count;
+  }
+
+  void show() { frames++; }
+  void delay(unsigned long ms);
+  void setBrightness(uint8_t scale) { brightness = scale; }
+  uint8_t getBrightness() { return brightness; }
+
+  CRGB *leds = NULL;
+  int ledCount = 0;
+  uint8_t brightness = 255;
+  uint32_t frames = 0;  // calls of show()
+};
+
+extern CFastLED FastLED;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "WString.h"
+
+class IPAddress {
+ public:
+  IPAddress() : bytes{0, 0, 0, 0} {}
+  IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+      : bytes{first, second, third, fourth} {}
+
+  uint8_t operator[](int index) const { return bytes[index]; }
+  uint8_t &operator[](int index) { return bytes[index]; }
+  bool operator==(const IPAddress &other) const {
+    return bytes[0] == other.bytes[0] && bytes[1] == other.bytes[1] &&
+           bytes[2] == other.bytes[2] && bytes[3] == other.bytes[3];
+  }
+  bool operator!=(const IPAddress &other) const { return !(*this == other); }
+
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2],
+             bytes[3]);
+    return String(text);
+  }
+
+ private:
+  uint8_t bytes[4];
+};
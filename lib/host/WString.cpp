@@ -0,0 +1,84 @@
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <strings.h>
+
+bool String::concat(const char *text) {
+  if (text) value.append(text);
+  return true;
+}
+
+bool String::concat(char c) {
+  value.push_back(c);
+  return true;
+}
+
+bool String::equalsIgnoreCase(const String &other) const {
+  return strcasecmp(c_str(), other.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const {
+  return value.compare(0, prefix.value.length(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+  return value.length() >= suffix.value.length() &&
+         value.compare(value.length() - suffix.value.length(),
+                       suffix.value.length(), suffix.value) == 0;
+}
+
+char String::operator[](unsigned int index) const {
+  return index < value.length() ? value[index] : 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t found = value.find(c, from);
+  return found == std::string::npos ? -1 : found;
+}
+
+int String::indexOf(const String &text, unsigned int from) const {
+  size_t found = value.find(text.value, from);
+  return found == std::string::npos ? -1 : found;
+}
+
+String String::substring(unsigned int from) const {
+  return substring(from, value.length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= value.length()) return String();
+  return String(value.substr(from, to - from).c_str());
+}
+
+void String::trim() {
+  size_t first = value.find_first_not_of(" \t\r\n");
+  size_t last = value.find_last_not_of(" \t\r\n");
+  value = first == std::string::npos ? "" : value.substr(first, last - first + 1);
+}
+
+void String::toLowerCase() {
+  for (char &c : value) c = tolower(c);
+}
+
+long String::toInt() const { return atol(value.c_str()); }
+
+// Like the core, the sum is built in the left temporary
+StringSumHelper &operator+(const StringSumHelper &left, const String &right) {
+  StringSumHelper &sum = const_cast<StringSumHelper &>(left);
+  sum.concat(right);
+  return sum;
+}
+
+StringSumHelper &operator+(const StringSumHelper &left, const char *right) {
+  StringSumHelper &sum = const_cast<StringSumHelper &>(left);
+  sum.concat(right);
+  return sum;
+}
+
+StringSumHelper &operator+(const StringSumHelper &left, char right) {
+  StringSumHelper &sum = const_cast<StringSumHelper &>(left);
+  sum.concat(right);
+  return sum;
+}
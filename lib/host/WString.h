@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+// *************************
+// ** Host String **
+// *************************
+// The Arduino String API the firmware and ArduinoJson use, on top of
+// std::string. Only that API is exposed, so code that builds here also builds
+// against the real core.
+
+class String {
+ public:
+  String(const char *text = "") : value(text ? text : "") {}
+  explicit String(char c) : value(1, c) {}
+  explicit String(int number) : value(std::to_string(number)) {}
+  explicit String(unsigned int number) : value(std::to_string(number)) {}
+  explicit String(long number) : value(std::to_string(number)) {}
+  explicit String(unsigned long number) : value(std::to_string(number)) {}
+
+  unsigned int length() const { return value.length(); }
+  bool isEmpty() const { return value.empty(); }
+  const char *c_str() const { return value.c_str(); }
+  bool reserve(unsigned int size) {
+    value.reserve(size);
+    return true;
+  }
+
+  bool concat(const String &text) { return concat(text.c_str()); }
+  bool concat(const char *text);
+  bool concat(char c);
+  String &operator+=(const String &text) {
+    concat(text);
+    return *this;
+  }
+  String &operator+=(const char *text) {
+    concat(text);
+    return *this;
+  }
+  String &operator+=(char c) {
+    concat(c);
+    return *this;
+  }
+
+  int compareTo(const String &other) const { return value.compare(other.value); }
+  bool equals(const String &other) const { return value == other.value; }
+  bool equals(const char *other) const { return value == (other ? other : ""); }
+  bool equalsIgnoreCase(const String &other) const;
+  bool operator==(const String &other) const { return equals(other); }
+  bool operator==(const char *other) const { return equals(other); }
+  bool operator!=(const String &other) const { return !equals(other); }
+  bool operator!=(const char *other) const { return !equals(other); }
+  bool startsWith(const String &prefix) const;
+  bool endsWith(const String &suffix) const;
+
+  char charAt(unsigned int index) const { return (*this)[index]; }
+  char operator[](unsigned int index) const;
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &text, unsigned int from = 0) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  void trim();
+  void toLowerCase();
+  long toInt() const;
+
+ private:
+  std::string value;
+};
+
+// Result of operator+, ArduinoJson knows it by name
+class StringSumHelper : public String {
+ public:
+  StringSumHelper(const String &text) : String(text) {}
+  StringSumHelper(const char *text) : String(text) {}
+};
+
+StringSumHelper &operator+(const StringSumHelper &left, const String &right);
+StringSumHelper &operator+(const StringSumHelper &left, const char *right);
+StringSumHelper &operator+(const StringSumHelper &left, char right);
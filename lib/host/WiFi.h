@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+// *************************
+// ** Host WiFi **
+// *************************
+// Always connected. The address is 127.0.0.1 unless set with config(), every
+// node of a loopback test picks its own 127.0.0.x.
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2 } wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+ public:
+  bool mode(wifi_mode_t mode) { return true; }
+  wl_status_t begin(const char *ssid, const char *password) {
+    return WL_CONNECTED;
+  }
+  bool config(IPAddress local, IPAddress gateway = IPAddress(),
+              IPAddress subnet = IPAddress()) {
+    address = local;
+    return true;
+  }
+  wl_status_t status() { return WL_CONNECTED; }
+  IPAddress localIP() { return address; }
+
+ private:
+  IPAddress address = IPAddress(127, 0, 0, 1);
+};
+
+extern WiFiClass WiFi;
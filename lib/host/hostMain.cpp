@@ -0,0 +1,11 @@
+#include <Arduino.h>
+
+// The firmware as a Linux program, the unit tests bring their own main
+#ifndef PIO_UNIT_TESTING
+int main() {
+  setup();
+  for (;;) {
+    loop();
+  }
+}
+#endif
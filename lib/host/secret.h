@@ -0,0 +1,3 @@
+// The host build is always connected, a src/secret.h takes precedence
+#define WIFI_SSID "host"
+#define WIFI_PASSWORD "host"
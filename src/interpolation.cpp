@@ -0,0 +1,43 @@
+#include "interpolation.h"
+
+void renderInterpolated(KeyframeBuffer &frames, KeyframeRenderer render,
+                        uint32_t time, uint16_t keyframeFps, CRGB *output) {
+  uint32_t interval = max(1000 / keyframeFps, 1);
+  uint32_t keyframeTime = time - time % interval;
+  uint32_t due = keyframeTime + interval;
+
+  // Start over for a new effect, after a stall or when the clock jumped
+  int32_t ahead = due - frames.nextTime;
+  if (frames.render != render || ahead < 0 || ahead > (int32_t)interval) {
+    frames.render = render;
+    render(frames.next, keyframeTime);
+    frames.nextTime = keyframeTime;
+  }
+
+  // Keyframes are rendered ahead, output at time sits between the two
+  if (frames.nextTime != due) {
+    memcpy(frames.previous, frames.next, frames.count * sizeof(CRGB));
+    render(frames.next, due);
+    frames.nextTime = due;
+  }
+
+  fract8 amount = (time - keyframeTime) * 256 / interval;
+  for (uint16_t i = 0; i < frames.count; i++) {
+    output[i] = blend(frames.previous[i], frames.next[i], amount);
+  }
+}
+
+const CRGB *cachedPalette(PaletteCache &cache, const CRGBPalette16 &palette,
+                          uint8_t brightness, TBlendType blendType) {
+  if (!cache.valid || cache.palette != palette ||
+      cache.brightness != brightness || cache.blendType != blendType) {
+    for (int i = 0; i < 256; i++) {
+      cache.colors[i] = ColorFromPalette(palette, i, brightness, blendType);
+    }
+    cache.palette = palette;
+    cache.brightness = brightness;
+    cache.blendType = blendType;
+    cache.valid = true;
+  }
+  return cache.colors;
+}
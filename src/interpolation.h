@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// *************************
+// ** Keyframe Interpolation **
+// *************************
+// Effects render keyframes at a low logical rate, the output frames in
+// between are blended from the two keyframes around them. The next keyframe
+// is rendered ahead, so output is not delayed, and the render cost is only
+// paid per keyframe.
+//
+// A crossfade only suits fields like noise or plasma, so keyframeFps applies
+// to those only. A moving shape would show at both keyframe positions at
+// once, so moving effects draw at output time and only cache what does not
+// move, see PaletteCache.
+
+typedef void (*KeyframeRenderer)(CRGB *target, uint32_t time);
+
+typedef struct {
+  CRGB *previous;
+  CRGB *next;
+  uint16_t count;
+  uint32_t nextTime;  // time next was rendered for
+  KeyframeRenderer render;
+} KeyframeBuffer;
+
+// Writes the output frame for time into output. Keyframes are rendered on
+// multiples of 1000 / keyframeFps, so nodes sharing a clock stay aligned.
+void renderInterpolated(KeyframeBuffer &frames, KeyframeRenderer render,
+                        uint32_t time, uint16_t keyframeFps, CRGB *output);
+
+// The palette at brightness for all 256 indices, so a scrolling palette
+// only looks up colors per output frame
+typedef struct {
+  CRGB colors[256];
+  // What the colors were built from
+  CRGBPalette16 palette;
+  uint8_t brightness;
+  TBlendType blendType;
+  bool valid;
+} PaletteCache;
+
+// Colors of palette, rebuilt only when palette, brightness or blendType
+// changed since the last call
+const CRGB *cachedPalette(PaletteCache &cache, const CRGBPalette16 &palette,
+                          uint8_t brightness, TBlendType blendType);
@@ -5,43 +5,71 @@
 // ** LEDEffect Starter Functions **
 // *************************
 void FadeInOutEffect();
+void FadeInOutFrame(CRGB *target, uint32_t time);
 void StrobeEffect();
+void StrobeFrame(CRGB *target, uint32_t time);
 void CylonBounceEffect();
+void CylonBounceFrame(CRGB *target, uint32_t time);
 void NewKITTEffect();
+void NewKITTFrame(CRGB *target, uint32_t time);
 void TwinkleEffect();
 void TwinkleRandomEffect();
 void SparkleEffect();
 void SnowSparkleEffect();
 void RunningLightsEffect();
+void RunningLightsFrame(CRGB *target, uint32_t time);
 void colorWipeEffect();
+void colorWipeFrame(CRGB *target, uint32_t time);
 void theaterChaseEffect();
+void theaterChaseFrame(CRGB *target, uint32_t time);
 void theaterChaseRainbowEffect();
+void theaterChaseRainbowFrame(CRGB *target, uint32_t time);
 void meteorRainEffect();
+void NoiseEffect();
+void NoiseKeyframe(CRGB *target, uint32_t time);
+void FireEffect();
+void FireKeyframe(CRGB *target, uint32_t time);
+void PlasmaEffect();
+void PlasmaKeyframe(CRGB *target, uint32_t time);
 
 // *************************
 // ** LEDEffect Functions **
 // *************************
 
-void FadeInOut(CRGB color);
+// The effects below draw the frame at time into target, so all nodes sharing
+// a clock show the same step
 
-void Strobe(CRGB color, int StrobeCount, int FlashDelay, int EndPause);
+// Steps of one fade in and out
+#define FADE_STEPS 384
 
-void CylonBounce(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void FadeInOut(CRGB *target, uint32_t time, CRGB color, int SpeedDelay);
 
-void NewKITT(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void Strobe(CRGB *target, uint32_t time, CRGB color, int StrobeCount,
+            int FlashDelay, int EndPause);
 
-// used by NewKITT
-void CenterToOutside(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void CylonBounce(CRGB *target, uint32_t time, CRGB color, int EyeSize,
+                 int SpeedDelay, int ReturnDelay);
+
+// used by CylonBounce and NewKITT
+void drawEye(CRGB *target, int32_t position, CRGB color, int EyeSize);
+
+void NewKITT(CRGB *target, uint32_t time, CRGB color, int EyeSize,
+             int SpeedDelay, int ReturnDelay);
+
+// used by NewKITT, draw step of the move
+void CenterToOutside(CRGB *target, int step, CRGB color, int EyeSize);
 
 // used by NewKITT
-void OutsideToCenter(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void OutsideToCenter(CRGB *target, int step, CRGB color, int EyeSize);
 
 // used by NewKITT
-void LeftToRight(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void LeftToRight(CRGB *target, int step, CRGB color, int EyeSize);
 
 // used by NewKITT
-void RightToLeft(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay);
+void RightToLeft(CRGB *target, int step, CRGB color, int EyeSize);
 
+// Twinkle, TwinkleRandom, Sparkle, SnowSparkle and meteorRain render one
+// frame per call with the particle engine
 void Twinkle(CRGB color, int Count, int SpeedDelay, boolean OnlyOne);
 
 void TwinkleRandom(int Count, int SpeedDelay, boolean OnlyOne);
@@ -50,22 +78,22 @@ void Sparkle(CRGB color, int SpeedDelay);
 
 void SnowSparkle(CRGB color, int SparkleDelay, int SpeedDelay);
 
-void RunningLights(CRGB color, int WaveDelay);
+void RunningLights(CRGB *target, uint32_t time, CRGB color, int WaveDelay);
+
+// used by RunningLights
+void RunningLightsWave(CRGB *target, CRGB color, int Position);
 
-void colorWipe(CRGB color, int SpeedDelay);
+void colorWipe(CRGB *target, uint32_t time, CRGB color, int SpeedDelay);
 
 // used by rainbowCycle and theaterChaseRainbow
 byte * Wheel(byte WheelPos);
 
-void theaterChase(CRGB color, int SpeedDelay);
+void theaterChase(CRGB *target, uint32_t time, CRGB color, int SpeedDelay);
 
-void theaterChaseRainbow(int SpeedDelay);
+void theaterChaseRainbow(CRGB *target, uint32_t time, int SpeedDelay);
 
 void meteorRain(CRGB color, byte meteorSize, byte meteorTrailDecay, boolean meteorRandomDecay, int SpeedDelay);
 
-// used by meteorrain
-void fadeToBlack(int ledNo, byte fadeValue);
-
 
 // ***************************************
 // ** FastLed/NeoPixel Common Functions **
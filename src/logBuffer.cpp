@@ -0,0 +1,224 @@
+#include "logBuffer.h"
+
+#include <atomic>
+
+typedef struct {
+  // Slot i is free for ticket i and holds a message once it is ticket i + 1
+  std::atomic<uint32_t> sequence;
+  uint8_t level;
+  uint32_t time;
+  const char *format;
+  uint8_t argCount;
+  uint32_t args[LOG_ARGS];  // integers, or offsets into strings for %s
+  char strings[LOG_STRING_LENGTH];
+} LogSlot;
+
+static const char *levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+static LogSlot slots[LOG_SLOTS];
+static std::atomic<uint32_t> head(0);  // next producer ticket
+static uint32_t readPosition = 0;      // consumer only
+static std::atomic<uint32_t> dropped(0);
+
+// Drained lines, only touched by the consumer and getLogTail
+static char tail[LOG_TAIL][LOG_MESSAGE_LENGTH];
+static uint8_t tailNext = 0;
+static uint8_t tailCount = 0;
+static SemaphoreHandle_t tailMutex;
+
+uint8_t logLevel = LOG_LEVEL_INFO;
+
+static bool initLog() {
+  for (uint32_t i = 0; i < LOG_SLOTS; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  tailMutex = xSemaphoreCreateMutex();
+  return true;
+}
+
+// Set up on first use, so messages logged before beginLog are kept
+static void ensureLog() {
+  static bool ready = initLog();
+  (void)ready;
+}
+
+// Parses the conversion after a '%'. Returns the conversion character, sets
+// isLong for an l or z modifier and end to the character after it.
+static char parseConversion(const char *spec, bool &isLong, const char *&end) {
+  while (*spec != '\0' && strchr("-+ #0123456789.", *spec) != NULL) spec++;
+  isLong = false;
+  while (*spec == 'l' || *spec == 'h' || *spec == 'z') {
+    if (*spec != 'h') isLong = true;
+    spec++;
+  }
+  end = *spec != '\0' ? spec + 1 : spec;
+  return *spec;
+}
+
+// Keeps the arguments of format in slot. Strings are copied, the buffer of
+// the caller may be gone by the time the drain task formats the message.
+static void captureArgs(LogSlot &slot, const char *format, va_list args) {
+  uint8_t count = 0;
+  size_t used = 0;
+  const char *p = format;
+  while (count < LOG_ARGS && (p = strchr(p, '%')) != NULL) {
+    bool isLong;
+    char conversion = parseConversion(p + 1, isLong, p);
+    if (conversion == '%') continue;
+    if (conversion == 's') {
+      const char *text = va_arg(args, const char *);
+      slot.args[count++] = used;
+      used += strlcpy(slot.strings + used, text != NULL ? text : "(null)",
+                      LOG_STRING_LENGTH - used) + 1;
+      // Truncated, later strings share the final terminator and are empty
+      if (used > LOG_STRING_LENGTH - 1) used = LOG_STRING_LENGTH - 1;
+    } else if (conversion != '\0' && strchr("diuxXoc", conversion) != NULL) {
+      slot.args[count++] = isLong ? va_arg(args, unsigned long)
+                                  : va_arg(args, unsigned int);
+    } else {
+      break;  // unsupported, the message ends here
+    }
+  }
+  slot.argCount = count;
+}
+
+// Formats the message of slot into line, one conversion at a time
+static void formatMessage(const LogSlot &slot, char *line, size_t size) {
+  size_t length = 0;
+  uint8_t count = 0;
+  const char *p = slot.format;
+  while (*p != '\0' && length < size - 1) {
+    if (*p != '%') {
+      line[length++] = *p++;
+      continue;
+    }
+    bool isLong;
+    const char *end;
+    char conversion = parseConversion(p + 1, isLong, end);
+    if (conversion == '%') {
+      line[length++] = '%';
+      p = end;
+      continue;
+    }
+    char spec[16];
+    if (count == slot.argCount || (size_t)(end - p) >= sizeof(spec)) break;
+    memcpy(spec, p, end - p);
+    spec[end - p] = '\0';
+
+    uint32_t arg = slot.args[count++];
+    char *out = line + length;
+    size_t room = size - length;
+    int written;
+    if (conversion == 's') {
+      written = snprintf(out, room, spec, slot.strings + arg);
+    } else if (isLong && (conversion == 'd' || conversion == 'i')) {
+      written = snprintf(out, room, spec, (long)(int32_t)arg);
+    } else if (isLong) {
+      written = snprintf(out, room, spec, (unsigned long)arg);
+    } else {
+      written = snprintf(out, room, spec, (unsigned int)arg);
+    }
+    if (written < 0) break;
+    length = min(length + written, size - 1);
+    p = end;
+  }
+  line[length] = '\0';
+}
+
+void logMessage(uint8_t level, const char *format, ...) {
+  if (level < logLevel) return;
+  ensureLog();
+
+  // Claim a ticket, give up instead of waiting when the ring is full
+  uint32_t position = head.load(std::memory_order_relaxed);
+  LogSlot *slot;
+  for (;;) {
+    slot = &slots[position % LOG_SLOTS];
+    int32_t diff =
+        slot->sequence.load(std::memory_order_acquire) - position;
+    if (diff == 0) {
+      if (head.compare_exchange_weak(position, position + 1,
+                                     std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = head.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->level = level;
+  slot->time = millis();
+  slot->format = format;
+  va_list args;
+  va_start(args, format);
+  captureArgs(*slot, format, args);
+  va_end(args);
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+uint32_t droppedLogMessages() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+uint8_t getLogTail(char lines[][LOG_MESSAGE_LENGTH], uint8_t maxLines) {
+  ensureLog();
+  xSemaphoreTake(tailMutex, portMAX_DELAY);
+  uint8_t count = min(tailCount, maxLines);
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t index = (tailNext + LOG_TAIL - count + i) % LOG_TAIL;
+    memcpy(lines[i], tail[index], LOG_MESSAGE_LENGTH);
+  }
+  xSemaphoreGive(tailMutex);
+  return count;
+}
+
+static void addToTail(const char *line) {
+  xSemaphoreTake(tailMutex, portMAX_DELAY);
+  strlcpy(tail[tailNext], line, LOG_MESSAGE_LENGTH);
+  tailNext = (tailNext + 1) % LOG_TAIL;
+  if (tailCount < LOG_TAIL) tailCount++;
+  xSemaphoreGive(tailMutex);
+}
+
+bool readLogMessage(char line[LOG_MESSAGE_LENGTH]) {
+  ensureLog();
+  LogSlot &slot = slots[readPosition % LOG_SLOTS];
+  if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1) {
+    return false;
+  }
+
+  char message[LOG_MESSAGE_LENGTH];
+  formatMessage(slot, message, sizeof(message));
+  snprintf(line, LOG_MESSAGE_LENGTH, "%lu %s %s", (unsigned long)slot.time,
+           levelNames[slot.level], message);
+  slot.sequence.store(readPosition + LOG_SLOTS, std::memory_order_release);
+  readPosition++;
+
+  addToTail(line);
+  return true;
+}
+
+static void logTask(void *parameter) {
+  char line[LOG_MESSAGE_LENGTH];
+  uint32_t reportedDrops = 0;
+  for (;;) {
+    if (!readLogMessage(line)) {
+      uint32_t drops = droppedLogMessages();
+      if (drops != reportedDrops) {
+        Serial.printf("%lu log messages dropped\n",
+                      (unsigned long)(drops - reportedDrops));
+        reportedDrops = drops;
+      }
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+      continue;
+    }
+    Serial.println(line);
+  }
+}
+
+void beginLog() {
+  ensureLog();
+  xTaskCreate(logTask, "log", 3072, NULL, 1, NULL);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+// *************************
+// ** Log Ring Buffer **
+// *************************
+// Producers put the format and its raw arguments into a slot of a fixed
+// lock-free ring buffer (multiple producers, one consumer) and never format
+// or wait for Serial. A low priority task formats the messages, drains them
+// to Serial and keeps the last LOG_TAIL lines for GET /logs. When the ring is
+// full the message is dropped and counted.
+//
+// The format has to be a string literal. Only integer conversions (d, i, u,
+// x, X, o, c, with l, h or z) and %s are supported, at most LOG_ARGS per
+// message. Strings are copied, LOG_STRING_LENGTH bytes for all of them.
+
+#define LOG_SLOTS 32  // power of two
+#define LOG_ARGS 4
+#define LOG_STRING_LENGTH 64
+#define LOG_MESSAGE_LENGTH 96
+#define LOG_TAIL 16
+
+enum { LOG_LEVEL_DEBUG, LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR };
+
+#define LOG_DEBUG(...) logMessage(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) logMessage(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) logMessage(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) logMessage(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Messages below this level are skipped before formatting
+extern uint8_t logLevel;
+
+// Start the drain task
+void beginLog();
+
+// Takes the oldest message out of the ring, formats it into line and adds it
+// to the tail. Returns false if the ring is empty. The ring has one consumer,
+// the drain task, so only call this without it, as the tests do.
+bool readLogMessage(char line[LOG_MESSAGE_LENGTH]);
+
+// printf style with the limits above, safe to call from any task
+void logMessage(uint8_t level, const char *format, ...);
+
+uint32_t droppedLogMessages();
+
+// Copies the last drained lines, oldest first, returns how many
+uint8_t getLogTail(char lines[][LOG_MESSAGE_LENGTH], uint8_t maxLines);
@@ -6,8 +6,16 @@
 #include <FastLED.h>
 #include <WiFi.h>
 
+#include "interpolation.h"
 #include "ledEffects.h"
+#include "logBuffer.h"
+#include "noiseEffects.h"
+#include "particles.h"
+#include "pixelShader.h"
 #include "secret.h"
+#include "sequencer.h"
+#include "stats.h"
+#include "timeSync.h"
 
 #define LED_PIN 2
 #define NUM_LEDS 300
@@ -15,6 +23,12 @@
 #define COLOR_ORDER GRB
 
 CRGB leds[NUM_LEDS];
+ParticlePool particles;
+
+CRGB previousKeyframe[NUM_LEDS];
+CRGB nextKeyframe[NUM_LEDS];
+KeyframeBuffer keyframes = {previousKeyframe, nextKeyframe, NUM_LEDS, 0, NULL};
+PaletteCache paletteCache;
 
 AsyncWebServer server(80);
 
@@ -39,11 +53,27 @@ PaletteWithName palettes[] = {
 uint8_t palettesCount = sizeof(palettes) / sizeof(palettes[0]);
 
 typedef struct {
-  const String name;
+  String name;
   bool hasCustomColor;
   void (*effect)();
 } EffectWithName;
 
+// Uploaded shader effects. Uploads are compiled into a temporary and copied
+// in under shaderMutex, which the loop holds while it renders a frame.
+#define MAX_SHADER_EFFECTS 4
+// Longer names would not fit the settings and effects JSON documents
+#define MAX_EFFECT_NAME 24
+
+ShaderProgram shaderPrograms[MAX_SHADER_EFFECTS];
+SemaphoreHandle_t shaderMutex;
+
+void runShaderEffect(uint8_t slot);
+
+template <uint8_t slot>
+void ShaderEffect() {
+  runShaderEffect(slot);
+}
+
 EffectWithName effects[] = {
     {"FadeInOut", false, &FadeInOutEffect},
     {"Strobe", true, &StrobeEffect},
@@ -57,9 +87,19 @@ EffectWithName effects[] = {
     {"colorWipe", true, &colorWipeEffect},
     {"theaterChase", true, &theaterChaseEffect},
     {"theaterChaseRainbow", false, &theaterChaseRainbowEffect},
-    {"meteorRain", true, &meteorRainEffect}};
+    {"meteorRain", true, &meteorRainEffect},
+    {"Noise", false, &NoiseEffect},
+    {"Fire", false, &FireEffect},
+    {"Plasma", false, &PlasmaEffect},
+    // Free slots for uploaded shader effects
+    {"", false, &ShaderEffect<0>},
+    {"", false, &ShaderEffect<1>},
+    {"", false, &ShaderEffect<2>},
+    {"", false, &ShaderEffect<3>}};
 
-uint8_t effectsCount = sizeof(effects) / sizeof(effects[0]);
+const uint8_t builtinEffectsCount =
+    sizeof(effects) / sizeof(effects[0]) - MAX_SHADER_EFFECTS;
+uint8_t effectsCount = builtinEffectsCount;
 
 
 int currentMode = 0;
@@ -67,23 +107,133 @@ int currentPalette = 0;
 int currentStep = 3;
 int currentEffect = 0;
 long currentColor = 16711908;
-String currentColorHex = "0xFF00E4";
 boolean hasBlend = true;
 uint8_t brightness = 64;
 uint16_t fps = 100;
+// Keyframe rate of the crossfaded field effects Noise, Fire and Plasma, 0
+// renders every output frame. All other effects draw every output frame.
+uint16_t keyframeFps = 0;
+
+// Uploaded cue list. Uploads are parsed into a temporary and copied in under
+// sequenceMutex, which the loop holds while it advances the sequence.
+Sequence sequence;
+SemaphoreHandle_t sequenceMutex;
+// A POST /sequence body with MAX_CUES cues of 8 members, the names are not
+// copied
+#define SEQUENCE_JSON_SIZE                                    \
+  (JSON_ARRAY_SIZE(MAX_CUES) + MAX_CUES * JSON_OBJECT_SIZE(8) + \
+   JSON_OBJECT_SIZE(3))
+// Output level of the running cue transition
+uint8_t sequenceLevel = 255;
+
+// Runs render, which draws one frame into leds, shows the frame and records
+// the time of both in frameTime. Every effect draws through here.
+template <typename Render>
+void drawFrame(Render render) {
+  uint32_t start = micros();
+  render();
+  // Schicke Farben zu LED Strip
+  FastLED.show();
+  recordLatency(frameTime, micros() - start);
+}
 
-void FillLEDsFromPaletteColors(uint8_t colorIndex, CRGBPalette16 palette);
+void FillLEDsFromPaletteColors(CRGB *target, uint16_t position,
+                               CRGBPalette16 palette);
+void FillLEDsFromPaletteCache(CRGB *target, uint16_t position,
+                              const CRGB *colors);
+void PaletteFrame(CRGB *target, uint32_t time);
+void showFrame(KeyframeRenderer render, bool crossfade);
+void waitFrame(uint32_t ms);
+void runBenchmarks();
 
 String getSettingsAsJson() {
   StaticJsonDocument<384> doc;
   doc["currentMode"] = currentMode;
   doc["currentPalette"] = palettes[currentPalette].name;
-  doc["currentColor"] = currentColorHex;
+  char colorHex[11];
+  snprintf(colorHex, sizeof(colorHex), "0x%06lX", currentColor);
+  doc["currentColor"] = colorHex;
   doc["currentStep"] = currentStep;
   doc["currentEffect"] = effects[currentEffect].name;
   doc["hasBlend"] = hasBlend;
   doc["brightness"] = brightness;
   doc["fps"] = fps;
+  doc["keyframeFps"] = keyframeFps;
+  String jsonString;
+  serializeJson(doc, jsonString);
+  return jsonString;
+}
+
+String getTimeSyncAsJson() {
+  StaticJsonDocument<192> doc;
+  TimeSyncStatus status = getTimeSyncStatus();
+  doc["isLeader"] = status.isLeader;
+  doc["leader"] = IPAddress(status.leaderIp >> 24, status.leaderIp >> 16,
+                            status.leaderIp >> 8, status.leaderIp)
+                      .toString();
+  doc["peers"] = status.peers;
+  doc["offset"] = status.offset;
+  doc["rtt"] = status.rtt;
+  // Bound on the difference to the leader clock, not a measurement. The
+  // loopback test in test/test_time_sync measures the real skew.
+  doc["skewBound"] = status.rtt / 2;
+  String jsonString;
+  serializeJson(doc, jsonString);
+  return jsonString;
+}
+
+// Free heap right after setup, to see how much the heap grew since boot
+uint32_t bootFreeHeap = 0;
+
+void addLatencyToJson(JsonObject object, const LatencyHistogram &histogram) {
+  object["count"] = histogram.count;
+  object["p50"] = latencyPercentile(histogram, 50);
+  object["p90"] = latencyPercentile(histogram, 90);
+  object["p99"] = latencyPercentile(histogram, 99);
+  object["max"] = histogram.max;
+}
+
+String getStatsAsJson() {
+  StaticJsonDocument<384> doc;
+  // Latencies in us
+  addLatencyToJson(doc.createNestedObject("requests"), requestLatency);
+  addLatencyToJson(doc.createNestedObject("frames"), frameTime);
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["free"] = ESP.getFreeHeap();
+  heap["minFree"] = ESP.getMinFreeHeap();
+  heap["maxAlloc"] = ESP.getMaxAllocHeap();
+  heap["growth"] = (int32_t)(bootFreeHeap - ESP.getFreeHeap());
+  String jsonString;
+  serializeJson(doc, jsonString);
+  return jsonString;
+}
+
+String getLogsAsJson() {
+  // Static, the lines are referenced by the document, not copied
+  static char lines[LOG_TAIL][LOG_MESSAGE_LENGTH];
+  StaticJsonDocument<384> doc;
+  doc["dropped"] = droppedLogMessages();
+  JsonArray array = doc.createNestedArray("lines");
+  uint8_t count = getLogTail(lines, LOG_TAIL);
+  for (int i = 0; i < count; i++) {
+    array.add((const char *)lines[i]);
+  }
+  String jsonString;
+  serializeJson(doc, jsonString);
+  return jsonString;
+}
+
+String getSequenceAsJson() {
+  StaticJsonDocument<192> doc;
+  xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+  doc["running"] = sequence.running;
+  doc["finished"] = sequence.finished;
+  doc["loop"] = sequence.loop;
+  doc["cues"] = sequence.count;
+  doc["length"] = sequence.length;
+  doc["currentCue"] = sequence.current;
+  doc["pass"] = sequence.pass;
+  xSemaphoreGive(sequenceMutex);
   String jsonString;
   serializeJson(doc, jsonString);
   return jsonString;
@@ -101,7 +251,7 @@ String getAllPalettesAsJson() {
 }
 
 String getAllEffectsAsJson() {
-  StaticJsonDocument<1024> doc;
+  StaticJsonDocument<1536> doc;
   for (int i = 0; i < effectsCount; i++) {
     JsonObject effect = doc.createNestedObject();
     effect["name"] = effects[i].name;
@@ -116,13 +266,163 @@ void notFound(AsyncWebServerRequest *request) {
   request->send(404, "application/json", "{\"message\":\"Not found\"}");
 }
 
+// Palette index by name, -1 if unknown
+int findPalette(const String &name) {
+  for (int i = 0; i < palettesCount; i++) {
+    if (name.compareTo(palettes[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+// Effect index by name, -1 if unknown
+int findEffect(const String &name) {
+  for (int i = 0; i < effectsCount; i++) {
+    if (name.compareTo(effects[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+// Applies a PATCH /settings body, returns false if the palette or effect name
+// is unknown
+boolean applySettings(JsonObject data) {
+  // Search Mode
+  boolean foundMode = true;
+  if (data["currentPalette"]) {
+    int palette = findPalette(data["currentPalette"]);
+    foundMode = palette >= 0;
+    if (foundMode) currentPalette = palette;
+  }
+
+  // Search Effect
+  boolean foundEffect = true;
+  if (data["currentEffect"]) {
+    int effect = findEffect(data["currentEffect"]);
+    foundEffect = effect >= 0;
+    if (foundEffect) currentEffect = effect;
+  }
+
+  hasBlend = data["hasBlend"];
+  currentStep = data["currentStep"];
+
+  if (data["currentColor"]) {
+    // TODO Input validation
+    currentColor = strtol(data["currentColor"], NULL, 16);
+  }
+
+  currentMode = data["currentMode"];
+
+  if (data["brightness"]) {
+    // TODO Input validation
+    brightness = data["brightness"];
+  }
+  if (data["fps"]) {
+    // TODO Input validation
+    fps = data["fps"];
+  }
+  if (data.containsKey("keyframeFps")) {
+    keyframeFps = data["keyframeFps"];
+  }
+
+  return foundMode && foundEffect;
+}
+
+// Applies a PATCH /palettes/custom body, an array of 16 hex colors
+void applyCustomPalette(JsonArray array) {
+  long colorArray[16];
+  for (int i = 0; i < 16; i++) {
+    String hexColor = array[i].as<String>();
+    colorArray[i] = strtol(hexColor.c_str(), NULL, 16);
+  }
+  palettes[8].palette = CRGBPalette16(
+      colorArray[0], colorArray[1], colorArray[2], colorArray[3],
+      colorArray[4], colorArray[5], colorArray[6], colorArray[7],
+      colorArray[8], colorArray[9], colorArray[10], colorArray[11],
+      colorArray[12], colorArray[13], colorArray[14], colorArray[15]);
+}
+
+// Parses a POST /sequence body into sequence. Returns false with error set if
+// a palette or effect name is unknown or the cues can not be run.
+boolean parseSequence(JsonObject data, Sequence &sequence, String &error) {
+  JsonArray cues = data["cues"];
+  if (cues.size() > MAX_CUES) {
+    error = "too many cues";
+    return false;
+  }
+
+  sequence.count = 0;
+  sequence.loop = data["loop"] | false;
+  for (JsonObject item : cues) {
+    Cue &cue = sequence.cues[sequence.count++];
+    cue.offset = item["at"] | 0;
+    cue.mode = item["mode"] | -1;
+
+    cue.effect = -1;
+    if (item["effect"]) {
+      cue.effect = findEffect(item["effect"]);
+      if (cue.effect < 0) {
+        error = "effect not found";
+        return false;
+      }
+    }
+
+    cue.palette = -1;
+    if (item["palette"]) {
+      cue.palette = findPalette(item["palette"]);
+      if (cue.palette < 0) {
+        error = "palette not found";
+        return false;
+      }
+    }
+
+    cue.hasColor = item.containsKey("color");
+    cue.color = strtol(item["color"] | "0", NULL, 16);
+
+    String transition = item["transition"] | "cut";
+    cue.transition =
+        transition == "fade" ? TRANSITION_FADE : TRANSITION_CUT;
+    cue.transitionTime = item["transitionTime"] | 0;
+    cue.duration = item["duration"] | 0;
+  }
+  const char *invalid = validateSequence(sequence);
+  if (invalid != NULL) {
+    error = invalid;
+    return false;
+  }
+  return true;
+}
+
+void applyCue(const Cue &cue) {
+  if (cue.mode >= 0) currentMode = cue.mode;
+  if (cue.effect >= 0) currentEffect = cue.effect;
+  if (cue.palette >= 0) currentPalette = cue.palette;
+  if (cue.hasColor) currentColor = cue.color;
+}
+
+// Effect index for an uploaded shader effect. An effect with the same name is
+// replaced, otherwise the next free slot is used. -1 if the name belongs to a
+// built-in effect or all slots are taken.
+int findShaderEffectIndex(const String &name) {
+  for (int i = 0; i < effectsCount; i++) {
+    if (name.compareTo(effects[i].name) == 0)
+      return i < builtinEffectsCount ? -1 : i;
+  }
+  if (effectsCount < builtinEffectsCount + MAX_SHADER_EFFECTS)
+    return effectsCount;
+  return -1;
+}
+
 void setup() {
   // put your setup code here, to run once:
   delay(1000);
   Serial.begin(115200);
+  beginLog();
 
   FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS);
 
+#ifdef BENCHMARK
+  runBenchmarks();
+#endif
+
   WiFi.mode(WIFI_STA);  // Optional
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
   Serial.println("\nConnecting");
@@ -136,79 +436,77 @@ void setup() {
   Serial.print("Local ESP32 IP: ");
   Serial.println(WiFi.localIP());
 
+  beginTimeSync();
+
+  shaderMutex = xSemaphoreCreateMutex();
+  sequenceMutex = xSemaphoreCreateMutex();
+
   server.on("/palettes", HTTP_GET, [](AsyncWebServerRequest *request) {
-    Serial.println("get repuest on /palettes");
+    LatencyTimer timer(requestLatency);
+    LOG_INFO("get request on /palettes");
     request->send(200, "application/json", getAllPalettesAsJson());
   });
 
     server.on("/effects", HTTP_GET, [](AsyncWebServerRequest *request) {
-    Serial.println("get repuest on /palettes");
+    LatencyTimer timer(requestLatency);
+    LOG_INFO("get request on /effects");
     request->send(200, "application/json", getAllEffectsAsJson());
   });
 
   server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
-    Serial.println("get request on /settings");
+    LatencyTimer timer(requestLatency);
+    LOG_INFO("get request on /settings");
     request->send(200, "application/json", getSettingsAsJson());
   });
 
-  // PATCH /settings
-  AsyncCallbackJsonWebHandler *ledStripPatchHandler =
-      new AsyncCallbackJsonWebHandler(
-          "/settings", [](AsyncWebServerRequest *request, JsonVariant &json) {
-            if (request->method() == HTTP_PATCH) {
-              StaticJsonDocument<128> data;
-              if (json.is<JsonObject>()) {
-                data = json.as<JsonObject>();
-
-                // Search Mode
-                boolean foundMode = true;
-                if (data["currentPalette"]) {
-                  foundMode = false;
-                  String mode = data["currentPalette"];
-                  for (int i = 0; i < palettesCount; i++) {
-                    if (mode.compareTo(palettes[i].name) == 0) {
-                      currentPalette = i;
-                      foundMode = true;
-                      break;
-                    }
-                  }
-                }
+  server.on("/sequence", HTTP_GET, [](AsyncWebServerRequest *request) {
+    LatencyTimer timer(requestLatency);
+    request->send(200, "application/json", getSequenceAsJson());
+  });
 
-                // Search Effect
-                boolean foundEffect = true;
-                if (data["currentEffect"]) {
-                  foundEffect = false;
-                  String effect = data["currentEffect"];
-                  for (int i = 0; i < effectsCount; i++) {
-                    if (effect.compareTo(effects[i].name) == 0) {
-                      currentEffect = i;
-                      foundEffect = true;
-                      break;
-                    }
-                  }
-                }
+  server.on("/sequence", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+    LatencyTimer timer(requestLatency);
+    LOG_INFO("sequence stopped");
+    xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+    stopSequence(sequence);
+    xSemaphoreGive(sequenceMutex);
+    request->send(200, "application/json", getSequenceAsJson());
+  });
 
-                hasBlend = data["hasBlend"];
-                currentStep = data["currentStep"];
+  server.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", getLogsAsJson());
+  });
 
-                if (data["currentColor"]) {
-                  // TODO Input validation
-                  currentColorHex = data["currentColor"].as<String>();
-                  currentColor = strtol(data["currentColor"], NULL, 16);
-                }
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", getStatsAsJson());
+  });
 
-                currentMode = data["currentMode"];
+  // DELETE /stats starts a new measurement
+  server.on("/stats", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+    resetLatency(requestLatency);
+    resetLatency(frameTime);
+    request->send(200, "application/json", getStatsAsJson());
+  });
 
-                if (data["brightness"]) {
-                  // TODO Input validation
-                  brightness = data["brightness"];
-                }
-                if (data["fps"]) {
-                  // TODO Input validation
-                  fps = data["fps"];
-                }
+  server.on("/sync", HTTP_GET, [](AsyncWebServerRequest *request) {
+    LatencyTimer timer(requestLatency);
+    LOG_INFO("get request on /sync");
+    request->send(200, "application/json", getTimeSyncAsJson());
+  });
 
-                if (foundMode && foundEffect)
+  // PATCH /settings
+  AsyncCallbackJsonWebHandler *ledStripPatchHandler =
+      new AsyncCallbackJsonWebHandler(
+          "/settings", [](AsyncWebServerRequest *request, JsonVariant &json) {
+            LatencyTimer timer(requestLatency);
+            if (request->method() == HTTP_PATCH) {
+              if (json.is<JsonObject>()) {
+                // Manual settings take over from a running or finished
+                // sequence, which would otherwise keep the output dark
+                xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+                stopSequence(sequence);
+                xSemaphoreGive(sequenceMutex);
+                if (applySettings(json.as<JsonObject>()))
                   request->send(200, "application/json", getSettingsAsJson());
                 else
                   request->send(400, "application/json",
@@ -228,22 +526,10 @@ void setup() {
       new AsyncCallbackJsonWebHandler(
           "/palettes/custom",
           [](AsyncWebServerRequest *request, JsonVariant &json) {
+            LatencyTimer timer(requestLatency);
             if (request->method() == HTTP_PATCH) {
-              StaticJsonDocument<384> data;
               if (json.is<JsonArray>()) {
-                JsonArray array = json.as<JsonArray>();
-                long colorArray[16];
-                for (int i = 0; i < 16; i++) {
-                  String hexColor = array[i].as<String>();
-                  colorArray[i] = strtol(hexColor.c_str(), NULL, 16);
-                }
-                palettes[8].palette = CRGBPalette16(
-                    colorArray[0], colorArray[1], colorArray[2], colorArray[3],
-                    colorArray[4], colorArray[5], colorArray[6], colorArray[7],
-                    colorArray[8], colorArray[9], colorArray[10],
-                    colorArray[11], colorArray[12], colorArray[13],
-                    colorArray[14], colorArray[15]);
-
+                applyCustomPalette(json.as<JsonArray>());
                 request->send(200, "application/json", getSettingsAsJson());
 
               } else {
@@ -257,51 +543,164 @@ void setup() {
           });
   server.addHandler(customModePatchHandler);
 
+  // POST /sequence
+  AsyncCallbackJsonWebHandler *sequencePostHandler =
+      new AsyncCallbackJsonWebHandler(
+          "/sequence",
+          [](AsyncWebServerRequest *request, JsonVariant &json) {
+            LatencyTimer timer(requestLatency);
+            if (request->method() == HTTP_POST) {
+              if (json.is<JsonObject>()) {
+                // Static, too large for the stack of the web server task
+                static Sequence upload;
+                String error;
+                if (!parseSequence(json.as<JsonObject>(), upload, error)) {
+                  request->send(400, "application/json",
+                                String("{\"message\":\"Bad Request ") +
+                                    error + "\"}");
+                  return;
+                }
+                // Optional start on the shared clock, to start several
+                // nodes together
+                uint32_t start = json.containsKey("start")
+                                     ? json["start"].as<uint32_t>()
+                                     : networkMillis();
+                startSequence(upload, start);
+                xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+                sequence = upload;
+                xSemaphoreGive(sequenceMutex);
+                LOG_INFO("sequence with %d cues started", upload.count);
+
+                request->send(200, "application/json", getSequenceAsJson());
+              } else {
+                request->send(400, "application/json",
+                              "{\"message\":\"Bad Request no Json found\"}");
+              }
+            } else {
+              notFound(request);
+            }
+          },
+          SEQUENCE_JSON_SIZE);
+  server.addHandler(sequencePostHandler);
+
+  // POST /effects/custom
+  AsyncCallbackJsonWebHandler *shaderEffectPostHandler =
+      new AsyncCallbackJsonWebHandler(
+          "/effects/custom",
+          [](AsyncWebServerRequest *request, JsonVariant &json) {
+            LatencyTimer timer(requestLatency);
+            if (request->method() == HTTP_POST) {
+              if (json.is<JsonObject>()) {
+                JsonObject data = json.as<JsonObject>();
+                String name = data["name"] | "";
+                const char *source = data["source"] | "";
+
+                int index = findShaderEffectIndex(name);
+                if (name.length() == 0 || name.length() > MAX_EFFECT_NAME ||
+                    index < 0) {
+                  request->send(400, "application/json",
+                                "{\"message\":\"Bad Request name invalid or no free slot\"}");
+                  return;
+                }
+
+                ShaderProgram program;
+                String error;
+                if (!compileShader(source, program, error)) {
+                  LOG_WARN("shader %s rejected: %s", name.c_str(),
+                           error.c_str());
+                  request->send(400, "application/json",
+                                String("{\"message\":\"Bad Request ") + error +
+                                    "\"}");
+                  return;
+                }
+                JsonArray params = data["params"];
+                for (int i = 0; i < SHADER_PARAMS; i++) {
+                  program.params[i] = params[i] | 0;
+                }
+                // Waits for the frame that may be rendering this slot
+                xSemaphoreTake(shaderMutex, portMAX_DELAY);
+                shaderPrograms[index - builtinEffectsCount] = program;
+                xSemaphoreGive(shaderMutex);
+
+                if (index == effectsCount) {
+                  effects[index].name = name;
+                  effectsCount++;
+                }
+
+                request->send(200, "application/json", getAllEffectsAsJson());
+              } else {
+                request->send(400, "application/json",
+                              "{\"message\":\"Bad Request no Json found\"}");
+              }
+            } else {
+              notFound(request);
+            }
+          });
+  server.addHandler(shaderEffectPostHandler);
+
   // CORS Stuff
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "*");
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods",
-                                       "PUT,POST,PATCH,GET,OPTIONS");
+                                       "PUT,POST,PATCH,GET,DELETE,OPTIONS");
   DefaultHeaders::Instance().addHeader("Access-Control-Max-Age", "600");
   server.on("/settings", HTTP_OPTIONS,
             [](AsyncWebServerRequest *request) { request->send(204); });
   server.on("/palettes/custom", HTTP_OPTIONS,
             [](AsyncWebServerRequest *request) { request->send(204); });
+  server.on("/effects/custom", HTTP_OPTIONS,
+            [](AsyncWebServerRequest *request) { request->send(204); });
+  server.on("/sequence", HTTP_OPTIONS,
+            [](AsyncWebServerRequest *request) { request->send(204); });
+  server.on("/stats", HTTP_OPTIONS,
+            [](AsyncWebServerRequest *request) { request->send(204); });
 
   server.begin();
 
+  bootFreeHeap = ESP.getFreeHeap();
   Serial.println("setup completed");
 }
 
 void loop() {
   // put your main code here, to run repeatedly:
+  // Cues are checked every frame against the shared clock, so nodes running
+  // the same sequence switch together
+  xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+  const Cue *cue;
+  while ((cue = updateSequence(sequence, networkMillis(), sequenceLevel)) !=
+         NULL) {
+    applyCue(*cue);
+  }
+  xSemaphoreGive(sequenceMutex);
+  FastLED.setBrightness(currentMode == 1 ? scale8(brightness, sequenceLevel)
+                                         : sequenceLevel);
+
+  // Particle effects start over on an empty strip when the effect changes
+  static int particleEffect = -1;
+  int effect = currentMode == 2 ? currentEffect : -1;
+  if (effect != particleEffect) {
+    releaseParticles(particles);
+    particleEffect = effect;
+  }
 
   switch (currentMode) {
     {
       case 0:
-        static uint8_t startIndex = 0;
-        startIndex = startIndex + 1; /* motion speed */
-
-        FillLEDsFromPaletteColors(startIndex, palettes[currentPalette].palette);
-        // Schicke Farben zu LED Strip
-        FastLED.show();
-
-        // Warte ein bisschen
-        FastLED.delay(1000 / fps);
+        showFrame(&PaletteFrame, false);
         break;
 
       case 1:
-        // Fill LEDS with a color
-        for (int i = 0; i < NUM_LEDS; i++) {
-          leds[i] = currentColor;
-        }
-        FastLED.setBrightness(brightness);
-        // Schicke Farben zu LED Strip
-        FastLED.show();
+        drawFrame([] {
+          // Fill LEDS with a color
+          for (int i = 0; i < NUM_LEDS; i++) {
+            leds[i] = currentColor;
+          }
+        });
 
         // Warte ein bisschen
-        FastLED.delay(1000 / fps);
+        waitFrame(1000 / fps);
         break;
+
       case 2:
         effects[currentEffect].effect();
         break;
@@ -312,40 +711,115 @@ void loop() {
   }
 }
 
-void FillLEDsFromPaletteColors(uint8_t colorIndex, CRGBPalette16 palette) {
+// Renders one output frame and waits for the next one. With crossfade, for
+// fields only, goes through keyframe interpolation when keyframeFps is below
+// fps.
+void showFrame(KeyframeRenderer render, bool crossfade) {
+  drawFrame([&] {
+    uint32_t time = networkMillis();
+    if (!crossfade || keyframeFps == 0 || keyframeFps >= fps) {
+      render(leds, time);
+    } else {
+      renderInterpolated(keyframes, render, time, keyframeFps, leds);
+    }
+  });
+
+  // Warte ein bisschen
+  waitFrame(1000 / fps);
+}
+
+// Waits ms for the next frame. Stops early when a cue is due, so cues switch
+// on time even behind the long waits of the particle effects.
+void waitFrame(uint32_t ms) {
+  uint32_t start = millis();
+  while (millis() - start < ms) {
+    xSemaphoreTake(sequenceMutex, portMAX_DELAY);
+    bool due = isSequenceDue(sequence, networkMillis());
+    xSemaphoreGive(sequenceMutex);
+    if (due) return;
+    FastLED.delay(1);
+  }
+}
+
+// position is the palette index of the first LED in 8.8 fixed point
+void FillLEDsFromPaletteColors(CRGB *target, uint16_t position,
+                               CRGBPalette16 palette) {
+  uint8_t colorIndex = position >> 8;
+  uint8_t fraction = position & 0xff;
+  TBlendType blendType = hasBlend ? LINEARBLEND : NOBLEND;
   for (int i = 0; i < NUM_LEDS; ++i) {
-    leds[i] = ColorFromPalette(palette, colorIndex, brightness,
-                               hasBlend ? LINEARBLEND : NOBLEND);
+    target[i] = ColorFromPalette(palette, colorIndex, brightness, blendType);
+    if (fraction && hasBlend) {
+      nblend(target[i],
+             ColorFromPalette(palette, colorIndex + 1, brightness, blendType),
+             fraction);
+    }
+    colorIndex += currentStep;
+  }
+}
+
+// Same as FillLEDsFromPaletteColors, with the colors looked up in colors
+void FillLEDsFromPaletteCache(CRGB *target, uint16_t position,
+                              const CRGB *colors) {
+  uint8_t colorIndex = position >> 8;
+  uint8_t fraction = position & 0xff;
+  for (int i = 0; i < NUM_LEDS; ++i) {
+    target[i] = colors[colorIndex];
+    if (fraction && hasBlend) {
+      nblend(target[i], colors[(uint8_t)(colorIndex + 1)], fraction);
+    }
     colorIndex += currentStep;
   }
 }
 
+void PaletteFrame(CRGB *target, uint32_t time) {
+  // Moves fps palette indices per second, taken from the shared clock so all
+  // nodes show the same position
+  uint16_t position = (uint64_t)time * fps * 256 / 1000;
+  // The position moves every output frame, the colors are only looked up
+  // again when the palette, brightness or blend changes
+  FillLEDsFromPaletteCache(
+      target, position,
+      cachedPalette(paletteCache, palettes[currentPalette].palette,
+                    brightness, hasBlend ? LINEARBLEND : NOBLEND));
+}
+
 // *************************
 // ** LEDEffect Starter Functions **
 // *************************
 
-void FadeInOutEffect() {
-  // FadeInOut - Color (red, green. blue)
-  FadeInOut(CRGB(0xff, 0x00, 0x00));  // red
-  FadeInOut(CRGB(0xff, 0xff, 0xff));  // white
-  FadeInOut(CRGB(0x00, 0x00, 0xff));  // blue
+void FadeInOutEffect() { showFrame(&FadeInOutFrame, false); }
+
+void FadeInOutFrame(CRGB *target, uint32_t time) {
+  // FadeInOut - Color (red, green. blue), speed delay. Red, white and blue
+  // take turns.
+  const CRGB colors[] = {CRGB(0xff, 0x00, 0x00), CRGB(0xff, 0xff, 0xff),
+                         CRGB(0x00, 0x00, 0xff)};
+  uint32_t fade = FADE_STEPS * 10;
+  FadeInOut(target, time % fade, colors[time / fade % 3], 10);
 }
 
-void StrobeEffect() {
+void StrobeEffect() { showFrame(&StrobeFrame, false); }
+
+void StrobeFrame(CRGB *target, uint32_t time) {
   // Strobe - Color (red, green, blue), number of flashes, flash speed, end
   // pause
-  Strobe(CRGB(currentColor), 10, 50, 1000);
+  Strobe(target, time, CRGB(currentColor), 10, 50, 1000);
 }
 
-void CylonBounceEffect() {
+void CylonBounceEffect() { showFrame(&CylonBounceFrame, false); }
+
+void CylonBounceFrame(CRGB *target, uint32_t time) {
   // CylonBounce - Color (red, green, blue), eye size, speed delay, end
   // pause
-  CylonBounce(CRGB(currentColor), 4, 10, 50);
+  CylonBounce(target, time, CRGB(currentColor), 4, 10, 50);
 }
 
-void NewKITTEffect() {
+void NewKITTEffect() { showFrame(&NewKITTFrame, false); }
+
+void NewKITTFrame(CRGB *target, uint32_t time) {
   // NewKITT - Color (red, green, blue), eye size, speed delay, end pause
-  NewKITT(CRGB(currentColor), 8, 10, 50);
+  NewKITT(target, time, CRGB(currentColor), 8, 10, 50);
 }
 
 void TwinkleEffect() {
@@ -369,27 +843,38 @@ void SnowSparkleEffect() {
   SnowSparkle(CRGB(0x10, 0x10, 0x10), 20, random(100, 1000));
 }
 
-void RunningLightsEffect() {
-  // Running Lights - Color (red, green, blue), wave dealy
-  RunningLights(CRGB(0xff, 0x00, 0x00), 50);  // red
-  RunningLights(CRGB(0xff, 0xff, 0xff), 50);  // white
-  RunningLights(CRGB(0x00, 0x00, 0xff), 50);  // blue
+void RunningLightsEffect() { showFrame(&RunningLightsFrame, false); }
+
+void RunningLightsFrame(CRGB *target, uint32_t time) {
+  // Running Lights - Color (red, green, blue), wave dealy. Red, white and
+  // blue take turns.
+  const CRGB colors[] = {CRGB(0xff, 0x00, 0x00), CRGB(0xff, 0xff, 0xff),
+                         CRGB(0x00, 0x00, 0xff)};
+  uint32_t run = NUM_LEDS * 2 * 50;
+  RunningLights(target, time % run, colors[time / run % 3], 50);
 }
 
-void colorWipeEffect() {
+void colorWipeEffect() { showFrame(&colorWipeFrame, false); }
+
+void colorWipeFrame(CRGB *target, uint32_t time) {
   // colorWipe - Color (red, green, blue), speed delay
-  colorWipe(CRGB(currentColor), 50);
-  colorWipe(CRGB(0x00, 0x00, 0x00), 50);
+  colorWipe(target, time, CRGB(currentColor), 50);
 }
 
-void theaterChaseEffect() {
+void theaterChaseEffect() { showFrame(&theaterChaseFrame, false); }
+
+void theaterChaseFrame(CRGB *target, uint32_t time) {
   // theatherChase - Color (red, green, blue), speed delay
-  theaterChase(CRGB(currentColor), 50);
+  theaterChase(target, time, CRGB(currentColor), 50);
 }
 
 void theaterChaseRainbowEffect() {
+  showFrame(&theaterChaseRainbowFrame, false);
+}
+
+void theaterChaseRainbowFrame(CRGB *target, uint32_t time) {
   // theaterChaseRainbow - Speed delay
-  theaterChaseRainbow(50);
+  theaterChaseRainbow(target, time, 50);
 }
 
 void meteorRainEffect() {
@@ -398,250 +883,266 @@ void meteorRainEffect() {
   meteorRain(CRGB(currentColor), 10, 64, true, 30);
 }
 
-// *************************
-// ** LEDEffect Functions **
-// *************************
-void FadeInOut(CRGB color) {
-  float r, g, b;
-
-  for (int k = 0; k < 256; k = k + 1) {
-    r = (k / 256.0) * color.red;
-    g = (k / 256.0) * color.green;
-    b = (k / 256.0) * color.blue;
-    setAll(CRGB(r, g, b));
-    showStrip();
-  }
+void NoiseEffect() { showFrame(&NoiseKeyframe, true); }
 
-  for (int k = 255; k >= 0; k = k - 2) {
-    r = (k / 256.0) * color.red;
-    g = (k / 256.0) * color.green;
-    b = (k / 256.0) * color.blue;
-    setAll(CRGB(r, g, b));
-    showStrip();
-  }
+void NoiseKeyframe(CRGB *target, uint32_t time) {
+  renderNoise(target, NUM_LEDS, time, palettes[currentPalette].palette,
+              brightness, hasBlend ? LINEARBLEND : NOBLEND);
 }
 
-void Strobe(CRGB color, int StrobeCount, int FlashDelay, int EndPause) {
-  for (int j = 0; j < StrobeCount; j++) {
-    setAll(color);
-    showStrip();
-    delay(FlashDelay);
-    setAll(CRGB(0, 0, 0));
+void FireEffect() { showFrame(&FireKeyframe, true); }
 
-    showStrip();
-    delay(FlashDelay);
-  }
-
-  delay(EndPause);
+void FireKeyframe(CRGB *target, uint32_t time) {
+  renderFire(target, NUM_LEDS, time, palettes[currentPalette].palette,
+             brightness, hasBlend ? LINEARBLEND : NOBLEND);
 }
 
-void CylonBounce(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  for (int i = 0; i < NUM_LEDS - EyeSize - 2; i++) {
-    setAll(CRGB(0, 0, 0));
-
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
-    }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    showStrip();
-    delay(SpeedDelay);
-  }
-
-  delay(ReturnDelay);
+void PlasmaEffect() { showFrame(&PlasmaKeyframe, true); }
 
-  for (int i = NUM_LEDS - EyeSize - 2; i > 0; i--) {
-    setAll(CRGB(0, 0, 0));
-
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
-    }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    showStrip();
-    delay(SpeedDelay);
-  }
+void PlasmaKeyframe(CRGB *target, uint32_t time) {
+  renderPlasma(target, NUM_LEDS, time, palettes[currentPalette].palette,
+               brightness, hasBlend ? LINEARBLEND : NOBLEND);
+}
 
-  delay(ReturnDelay);
+void runShaderEffect(uint8_t slot) {
+  // One frame of an uploaded shader effect
+  drawFrame([slot] {
+    xSemaphoreTake(shaderMutex, portMAX_DELAY);
+    runShader(shaderPrograms[slot], leds, NUM_LEDS, networkMillis(),
+              palettes[currentPalette].palette, brightness,
+              hasBlend ? LINEARBLEND : NOBLEND);
+    xSemaphoreGive(shaderMutex);
+  });
+  waitFrame(1000 / fps);
 }
 
-void NewKITT(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  RightToLeft(color, EyeSize, SpeedDelay, ReturnDelay);
-  LeftToRight(color, EyeSize, SpeedDelay, ReturnDelay);
-  OutsideToCenter(color, EyeSize, SpeedDelay, ReturnDelay);
-  CenterToOutside(color, EyeSize, SpeedDelay, ReturnDelay);
-  LeftToRight(color, EyeSize, SpeedDelay, ReturnDelay);
-  RightToLeft(color, EyeSize, SpeedDelay, ReturnDelay);
-  OutsideToCenter(color, EyeSize, SpeedDelay, ReturnDelay);
-  CenterToOutside(color, EyeSize, SpeedDelay, ReturnDelay);
+// *************************
+// ** LEDEffect Functions **
+// *************************
+// One fade in and out of FADE_STEPS steps of SpeedDelay, time is within it
+void FadeInOut(CRGB *target, uint32_t time, CRGB color, int SpeedDelay) {
+  // In with 256 steps, out with 128
+  uint32_t step = time / SpeedDelay % FADE_STEPS;
+  uint8_t level = step < 256 ? step : 255 - (step - 256) * 2;
+  fill_solid(target, NUM_LEDS,
+             CRGB(scale8(color.red, level), scale8(color.green, level),
+                  scale8(color.blue, level)));
 }
 
-// used by NewKITT
-void CenterToOutside(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  for (int i = ((NUM_LEDS - EyeSize) / 2); i >= 0; i--) {
-    setAll(CRGB(0, 0, 0));
+// StrobeCount flashes of FlashDelay on and off, then EndPause dark
+void Strobe(CRGB *target, uint32_t time, CRGB color, int StrobeCount,
+            int FlashDelay, int EndPause) {
+  uint32_t flashes = StrobeCount * 2 * FlashDelay;
+  uint32_t t = time % (flashes + EndPause);
+  bool on = t < flashes && (t / FlashDelay) % 2 == 0;
+  fill_solid(target, NUM_LEDS, on ? color : CRGB(0, 0, 0));
+}
 
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
-    }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
+// Eye at a fractional position from time, moving one pixel per SpeedDelay
+void CylonBounce(CRGB *target, uint32_t time, CRGB color, int EyeSize,
+                 int SpeedDelay, int ReturnDelay) {
+  uint32_t span = NUM_LEDS - EyeSize - 2;
+  uint32_t leg = span * SpeedDelay + ReturnDelay;
+  uint32_t t = time % (2 * leg);
+  uint32_t travel = min(t % leg, span * SpeedDelay);
+  int32_t position = travel * 256 / SpeedDelay;
+  if (t >= leg) position = span * 256 - position;
+
+  fill_solid(target, NUM_LEDS, CRGB(0, 0, 0));
+  drawEye(target, position, color, EyeSize);
+}
 
-    setPixel(NUM_LEDS - i,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(NUM_LEDS - i - j, color);
+// used by CylonBounce and NewKITT, the eye is one dim pixel, EyeSize full
+// pixels and one dim pixel. position is in 8.8 fixed point, the fraction
+// shifts the eye between two pixels.
+void drawEye(CRGB *target, int32_t position, CRGB color, int EyeSize) {
+  CRGB dim = CRGB(color.red / 10, color.green / 10, color.blue / 10);
+  CRGB pattern[2];  // the eye at j - 1 and j
+  int first = position >> 8;
+  uint8_t fraction = position & 0xff;
+
+  pattern[1] = CRGB(0, 0, 0);
+  for (int j = 0; j <= EyeSize + 2; j++) {
+    pattern[0] = pattern[1];
+    pattern[1] = (j == 0 || j == EyeSize + 1) ? dim
+                 : (j <= EyeSize)             ? color
+                                              : CRGB(0, 0, 0);
+    if (first + j >= 0 && first + j < NUM_LEDS) {
+      target[first + j] = blend(pattern[1], pattern[0], fraction);
     }
-    setPixel(NUM_LEDS - i - EyeSize - 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-
-    showStrip();
-    delay(SpeedDelay);
   }
-  delay(ReturnDelay);
 }
 
-// used by NewKITT
-void OutsideToCenter(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  for (int i = 0; i <= ((NUM_LEDS - EyeSize) / 2); i++) {
-    setAll(CRGB(0, 0, 0));
+// The moves of NewKITT in order
+enum { KITT_RIGHT_TO_LEFT, KITT_LEFT_TO_RIGHT, KITT_OUTSIDE_TO_CENTER,
+       KITT_CENTER_TO_OUTSIDE };
+static const uint8_t kittMoves[] = {
+    KITT_RIGHT_TO_LEFT,     KITT_LEFT_TO_RIGHT,     KITT_OUTSIDE_TO_CENTER,
+    KITT_CENTER_TO_OUTSIDE, KITT_LEFT_TO_RIGHT,     KITT_RIGHT_TO_LEFT,
+    KITT_OUTSIDE_TO_CENTER, KITT_CENTER_TO_OUTSIDE};
+
+static uint32_t kittSteps(uint8_t move, int EyeSize) {
+  return move == KITT_RIGHT_TO_LEFT || move == KITT_LEFT_TO_RIGHT
+             ? NUM_LEDS - EyeSize - 2
+             : (NUM_LEDS - EyeSize) / 2 + 1;
+}
 
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
+// Every move takes one step per SpeedDelay and holds its last step for
+// ReturnDelay
+void NewKITT(CRGB *target, uint32_t time, CRGB color, int EyeSize,
+             int SpeedDelay, int ReturnDelay) {
+  uint32_t cycle = 0;
+  for (uint8_t move : kittMoves) {
+    cycle += kittSteps(move, EyeSize) * SpeedDelay + ReturnDelay;
+  }
+  uint32_t t = time % cycle;
+
+  for (uint8_t move : kittMoves) {
+    uint32_t steps = kittSteps(move, EyeSize);
+    uint32_t length = steps * SpeedDelay + ReturnDelay;
+    if (t >= length) {
+      t -= length;
+      continue;
     }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-
-    setPixel(NUM_LEDS - i,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(NUM_LEDS - i - j,
-               CRGB(color.red / 10, color.green / 10, color.blue / 10));
+    int step = min(t / SpeedDelay, steps - 1);
+    fill_solid(target, NUM_LEDS, CRGB(0, 0, 0));
+    switch (move) {
+      case KITT_RIGHT_TO_LEFT:
+        RightToLeft(target, step, color, EyeSize);
+        break;
+      case KITT_LEFT_TO_RIGHT:
+        LeftToRight(target, step, color, EyeSize);
+        break;
+      case KITT_OUTSIDE_TO_CENTER:
+        OutsideToCenter(target, step, color, EyeSize);
+        break;
+      default:
+        CenterToOutside(target, step, color, EyeSize);
+        break;
     }
-    setPixel(NUM_LEDS - i - EyeSize - 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
+    return;
+  }
+}
 
-    showStrip();
-    delay(SpeedDelay);
+// used by NewKITT, the eye mirrored from the end of the strip, ending at
+// NUM_LEDS - i
+static void drawMirroredEye(CRGB *target, int i, CRGB color, int EyeSize) {
+  CRGB dim = CRGB(color.red / 10, color.green / 10, color.blue / 10);
+  for (int j = 0; j <= EyeSize + 1; j++) {
+    int pixel = NUM_LEDS - i - j;
+    if (pixel < 0 || pixel >= NUM_LEDS) continue;
+    target[pixel] = (j == 0 || j == EyeSize + 1) ? dim : color;
   }
-  delay(ReturnDelay);
 }
 
 // used by NewKITT
-void LeftToRight(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  for (int i = 0; i < NUM_LEDS - EyeSize - 2; i++) {
-    setAll(CRGB(0, 0, 0));
+void CenterToOutside(CRGB *target, int step, CRGB color, int EyeSize) {
+  int i = (NUM_LEDS - EyeSize) / 2 - step;
+  drawEye(target, i * 256, color, EyeSize);
+  drawMirroredEye(target, i, color, EyeSize);
+}
 
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
-    }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    showStrip();
-    delay(SpeedDelay);
-  }
-  delay(ReturnDelay);
+// used by NewKITT, the mirrored eye is dim
+void OutsideToCenter(CRGB *target, int step, CRGB color, int EyeSize) {
+  drawEye(target, step * 256, color, EyeSize);
+  drawMirroredEye(target, step,
+                  CRGB(color.red / 10, color.green / 10, color.blue / 10),
+                  EyeSize);
 }
 
 // used by NewKITT
-void RightToLeft(CRGB color, int EyeSize, int SpeedDelay, int ReturnDelay) {
-  for (int i = NUM_LEDS - EyeSize - 2; i > 0; i--) {
-    setAll(CRGB(0, 0, 0));
+void LeftToRight(CRGB *target, int step, CRGB color, int EyeSize) {
+  drawEye(target, step * 256, color, EyeSize);
+}
 
-    setPixel(i, CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    for (int j = 1; j <= EyeSize; j++) {
-      setPixel(i + j, color);
-    }
-    setPixel(i + EyeSize + 1,
-             CRGB(color.red / 10, color.green / 10, color.blue / 10));
-    showStrip();
-    delay(SpeedDelay);
-  }
-  delay(ReturnDelay);
+// used by NewKITT
+void RightToLeft(CRGB *target, int step, CRGB color, int EyeSize) {
+  drawEye(target, (NUM_LEDS - EyeSize - 2 - step) * 256, color, EyeSize);
 }
 
+// Twinkle, TwinkleRandom, Sparkle, SnowSparkle and meteorRain render one
+// frame per call on top of the particle pool
+
+// Fade time of a twinkle in frames is about Count
 void Twinkle(CRGB color, int Count, int SpeedDelay, boolean OnlyOne) {
-  setAll(CRGB(0, 0, 0));
-
-  for (int i = 0; i < Count; i++) {
-    setPixel(random(NUM_LEDS), color);
-    showStrip();
-    delay(SpeedDelay);
-    if (OnlyOne) {
-      setAll(CRGB(0, 0, 0));
-    }
-  }
+  drawFrame([&] {
+    useParticles(particles, effects[currentEffect].effect, leds, NUM_LEDS,
+                 CRGB(0, 0, 0));
 
-  delay(SpeedDelay);
+    if (particles.count < Count) {
+      spawnParticle(particles, random(NUM_LEDS), 0, color,
+                    OnlyOne ? 255 : min(768 / Count, 255), 0);
+    }
+    updateParticles(particles, leds, NUM_LEDS);
+  });
+  waitFrame(SpeedDelay);
 }
 
 void TwinkleRandom(int Count, int SpeedDelay, boolean OnlyOne) {
-  setAll(CRGB(0, 0, 0));
-
-  for (int i = 0; i < Count; i++) {
-    setPixel(random(NUM_LEDS),
-             CRGB(random(0, 255), random(0, 255), random(0, 255)));
-    showStrip();
-    delay(SpeedDelay);
-    if (OnlyOne) {
-      setAll(CRGB(0, 0, 0));
-    }
-  }
-
-  delay(SpeedDelay);
+  Twinkle(CRGB(random(0, 255), random(0, 255), random(0, 255)), Count,
+          SpeedDelay, OnlyOne);
 }
 
 void Sparkle(CRGB color, int SpeedDelay) {
-  int Pixel = random(NUM_LEDS);
-  setPixel(Pixel, color);
-  showStrip();
-  delay(SpeedDelay);
-  setPixel(Pixel, CRGB(0, 0, 0));
+  drawFrame([&] {
+    useParticles(particles, effects[currentEffect].effect, leds, NUM_LEDS,
+                 CRGB(0, 0, 0));
+
+    spawnParticle(particles, random(NUM_LEDS), 0, color, 255, 0);
+    updateParticles(particles, leds, NUM_LEDS);
+  });
+  waitFrame(SpeedDelay);
 }
 
+// Alternates between a frame with one white sparkle and a frame without
 void SnowSparkle(CRGB color, int SparkleDelay, int SpeedDelay) {
-  setAll(color);
-
-  int Pixel = random(NUM_LEDS);
-  setPixel(Pixel, CRGB(0xff, 0xff, 0xff));
-  showStrip();
-  delay(SparkleDelay);
-  setPixel(Pixel, color);
-  showStrip();
-  delay(SpeedDelay);
-}
-
-void RunningLights(CRGB color, int WaveDelay) {
-  int Position = 0;
-
-  for (int i = 0; i < NUM_LEDS * 2; i++) {
-    Position++;  // = 0; //Position + Rate;
-    for (int i = 0; i < NUM_LEDS; i++) {
-      // sine wave, 3 offset waves make a rainbow!
-      // float level = sin(i+Position) * 127 + 128;
-      // setPixel(i,level,0,0);
-      // float level = sin(i+Position) * 127 + 128;
-      setPixel(i, CRGB(((sin(i + Position) * 127 + 128) / 255) * color.red,
-                       ((sin(i + Position) * 127 + 128) / 255) * color.green,
-                       ((sin(i + Position) * 127 + 128) / 255) * color.blue));
+  boolean sparkling = false;
+  drawFrame([&] {
+    useParticles(particles, effects[currentEffect].effect, leds, NUM_LEDS,
+                 color);
+
+    sparkling = particles.count == 0;
+    if (sparkling) {
+      spawnParticle(particles, random(NUM_LEDS), 0, CRGB(0xff, 0xff, 0xff),
+                    255, 0);
     }
+    updateParticles(particles, leds, NUM_LEDS);
+  });
+  waitFrame(sparkling ? SparkleDelay : SpeedDelay);
+}
 
-    showStrip();
-    delay(WaveDelay);
+// The wave moves one pixel per WaveDelay, NUM_LEDS * 2 steps per color
+void RunningLights(CRGB *target, uint32_t time, CRGB color, int WaveDelay) {
+  RunningLightsWave(target, color, time / WaveDelay % (NUM_LEDS * 2) + 1);
+}
+
+// used by RunningLights
+void RunningLightsWave(CRGB *target, CRGB color, int Position) {
+  for (int i = 0; i < NUM_LEDS; i++) {
+    // sine wave, 3 offset waves make a rainbow!
+    // float level = sin(i+Position) * 127 + 128;
+    // setPixel(i,level,0,0);
+    // float level = sin(i+Position) * 127 + 128;
+    target[i] = CRGB(((sin(i + Position) * 127 + 128) / 255) * color.red,
+                     ((sin(i + Position) * 127 + 128) / 255) * color.green,
+                     ((sin(i + Position) * 127 + 128) / 255) * color.blue);
   }
 }
 
-void colorWipe(CRGB color, int SpeedDelay) {
+// Wipes color over the strip, then black, one pixel per SpeedDelay. The
+// leading pixel fades in.
+void colorWipe(CRGB *target, uint32_t time, CRGB color, int SpeedDelay) {
+  uint32_t wipe = NUM_LEDS * SpeedDelay;
+  uint32_t t = time % (2 * wipe);
+  CRGB from = t < wipe ? CRGB(0, 0, 0) : color;
+  CRGB to = t < wipe ? color : CRGB(0, 0, 0);
+  uint32_t position = (t % wipe) * 256 / SpeedDelay;
+  uint16_t filled = position >> 8;
+
   for (uint16_t i = 0; i < NUM_LEDS; i++) {
-    setPixel(i, color);
-    showStrip();
-    delay(SpeedDelay);
+    target[i] = i < filled ? to : from;
   }
+  if (filled < NUM_LEDS) target[filled] = blend(from, to, position & 0xff);
 }
 
 // used by rainbowCycle and theaterChaseRainbow
@@ -667,66 +1168,48 @@ byte *Wheel(byte WheelPos) {
   return c;
 }
 
-void theaterChase(CRGB color, int SpeedDelay) {
-  for (int j = 0; j < 10; j++) {  // do 10 cycles of chasing
-    for (int q = 0; q < 3; q++) {
-      for (int i = 0; i < NUM_LEDS; i = i + 3) {
-        setPixel(i + q, color);  // turn every third pixel on
-      }
-      showStrip();
-
-      delay(SpeedDelay);
-
-      for (int i = 0; i < NUM_LEDS; i = i + 3) {
-        setPixel(i + q, CRGB(0, 0, 0));  // turn every third pixel off
-      }
-    }
+// Every third pixel lit, moving on by one per SpeedDelay
+void theaterChase(CRGB *target, uint32_t time, CRGB color, int SpeedDelay) {
+  int q = time / SpeedDelay % 3;
+  fill_solid(target, NUM_LEDS, CRGB(0, 0, 0));
+  for (int i = q; i < NUM_LEDS; i = i + 3) {
+    target[i] = color;  // turn every third pixel on
   }
 }
 
-void theaterChaseRainbow(int SpeedDelay) {
+// As theaterChase, the colors move one wheel position every three steps
+void theaterChaseRainbow(CRGB *target, uint32_t time, int SpeedDelay) {
+  uint32_t step = time / SpeedDelay;
+  int q = step % 3;
+  int j = step / 3 % 256;  // cycle all 256 colors in the wheel
   byte *c;
 
-  for (int j = 0; j < 256; j++) {  // cycle all 256 colors in the wheel
-    for (int q = 0; q < 3; q++) {
-      for (int i = 0; i < NUM_LEDS; i = i + 3) {
-        c = Wheel((i + j) % 255);
-        setPixel(i + q,
-                 CRGB(*c, *(c + 1), *(c + 2)));  // turn every third pixel on
-      }
-      showStrip();
-
-      delay(SpeedDelay);
-
-      for (int i = 0; i < NUM_LEDS; i = i + 3) {
-        setPixel(i + q, CRGB(0, 0, 0));  // turn every third pixel off
-      }
-    }
+  fill_solid(target, NUM_LEDS, CRGB(0, 0, 0));
+  for (int i = 0; i + q < NUM_LEDS; i = i + 3) {
+    c = Wheel((i + j) % 255);
+    target[i + q] = CRGB(*c, *(c + 1), *(c + 2));  // turn every third pixel on
   }
 }
 
+// The meteor is meteorSize moving particles, the last one leaves the trail.
+// A new meteor starts once the trail of the last one faded out.
 void meteorRain(CRGB color, byte meteorSize, byte meteorTrailDecay,
                 boolean meteorRandomDecay, int SpeedDelay) {
-  setAll(CRGB(0, 0, 0));
-
-  for (int i = 0; i < NUM_LEDS + NUM_LEDS; i++) {
-    // fade brightness all LEDs one step
-    for (int j = 0; j < NUM_LEDS; j++) {
-      if ((!meteorRandomDecay) || (random(10) > 5)) {
-        leds[j].fadeToBlackBy(meteorTrailDecay);
+  drawFrame([&] {
+    useParticles(particles, effects[currentEffect].effect, leds, NUM_LEDS,
+                 CRGB(0, 0, 0));
+    particles.trailDecay = meteorTrailDecay;
+
+    if (particles.count == 0) {
+      uint8_t flags = meteorRandomDecay ? PARTICLE_RANDOM_DECAY : 0;
+      for (int j = 0; j < meteorSize; j++) {
+        spawnParticle(particles, -j, 1 << 8, color, 0,
+                      j == meteorSize - 1 ? flags | PARTICLE_TRAIL : flags);
       }
     }
-
-    // draw meteor
-    for (int j = 0; j < meteorSize; j++) {
-      if ((i - j < NUM_LEDS) && (i - j >= 0)) {
-        setPixel(i - j, color);
-      }
-    }
-
-    showStrip();
-    delay(SpeedDelay);
-  }
+    updateParticles(particles, leds, NUM_LEDS);
+  });
+  waitFrame(SpeedDelay);
 }
 
 // ***************************************
@@ -751,4 +1234,134 @@ void setAll(CRGB color) {
     setPixel(i, color);
   }
   showStrip();
-}
\ No newline at end of file
+}
+#ifdef BENCHMARK
+// ***************************************
+// ** Benchmarks **
+// ***************************************
+
+#define BENCHMARK_FRAMES 200
+
+// Average render time of one frame in microseconds
+uint32_t benchmarkFrames(void (*render)(uint16_t frame)) {
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+    render(frame);
+  }
+  return (micros() - start) / BENCHMARK_FRAMES;
+}
+
+void runShaderBenchmark() {
+  static ShaderProgram paletteShader;
+  static ShaderProgram runningLightsShader;
+  String error;
+  compileShader("pal = t / 10 + i * p0;", paletteShader, error);
+  paletteShader.params[0] = currentStep;
+  // sin() of whole radians in RunningLights, 256 / (2 * PI) = 41
+  compileShader("r = sin8((i + t / 50) * 41);", runningLightsShader, error);
+
+  Serial.println("Shader benchmark, us per frame:");
+  Serial.printf("  palette fill native:        %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  FillLEDsFromPaletteColors(leds, frame << 8,
+                                            palettes[currentPalette].palette);
+                }));
+  Serial.printf("  palette fill interpreted:   %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  runShader(paletteShader, leds, NUM_LEDS, frame * 10,
+                            palettes[currentPalette].palette, brightness,
+                            LINEARBLEND);
+                }));
+  Serial.printf("  RunningLights native:       %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  RunningLightsWave(leds, CRGB(0xff, 0x00, 0x00), frame);
+                }));
+  Serial.printf("  RunningLights interpreted:  %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  runShader(runningLightsShader, leds, NUM_LEDS, frame * 50,
+                            palettes[currentPalette].palette, brightness,
+                            LINEARBLEND);
+                }));
+}
+
+// Cost per frame should follow the live particles, not the strip length
+void runParticleBenchmark() {
+  static uint16_t stripLength;
+  const uint8_t liveCounts[] = {8, 32, MAX_PARTICLES};
+  const uint16_t stripLengths[] = {NUM_LEDS / 10, NUM_LEDS};
+
+  Serial.println("Particle benchmark, us per frame:");
+  for (uint8_t live : liveCounts) {
+    for (uint16_t length : stripLengths) {
+      stripLength = length;
+      releaseParticles(particles);
+      for (int i = 0; i < live; i++) {
+        spawnParticle(particles, random(length), 0, CRGB(0xff, 0x00, 0x00), 0,
+                      0);
+      }
+      Serial.printf("  %3d particles, %3d LEDs:  %u\n", live, length,
+                    benchmarkFrames([](uint16_t frame) {
+                      updateParticles(particles, leds, stripLength);
+                    }));
+    }
+  }
+  releaseParticles(particles);
+}
+
+// Output at 100 fps. The palette scroll looks its colors up per pixel or
+// from the cache, the Plasma field renders every frame or keyframes at 25 fps
+// that are crossfaded.
+void runInterpolationBenchmark() {
+  Serial.println("Interpolation benchmark, us per output frame:");
+  Serial.printf("  palette scroll uncached: %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  FillLEDsFromPaletteColors(
+                      leds, (uint32_t)frame * 10 * fps * 256 / 1000,
+                      palettes[currentPalette].palette);
+                }));
+  Serial.printf("  palette scroll cached:   %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  PaletteFrame(leds, frame * 10);
+                }));
+  Serial.printf("  Plasma native:           %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  PlasmaKeyframe(leds, frame * 10);
+                }));
+  Serial.printf("  Plasma crossfaded:       %u\n",
+                benchmarkFrames([](uint16_t frame) {
+                  renderInterpolated(keyframes, &PlasmaKeyframe, frame * 10,
+                                     25, leds);
+                }));
+}
+
+// Render time at NOISE_MAX_LEDS, 100 fps leaves 10000 us per frame
+void runNoiseBenchmark() {
+  static CRGB target[NOISE_MAX_LEDS];
+
+  Serial.printf("Noise benchmark, us per frame at %d LEDs:\n",
+                NOISE_MAX_LEDS);
+  Serial.printf("  Noise:   %u\n", benchmarkFrames([](uint16_t frame) {
+                  renderNoise(target, NOISE_MAX_LEDS, frame * 10,
+                              palettes[currentPalette].palette, brightness,
+                              LINEARBLEND);
+                }));
+  Serial.printf("  Fire:    %u\n", benchmarkFrames([](uint16_t frame) {
+                  renderFire(target, NOISE_MAX_LEDS, frame * 10,
+                             palettes[currentPalette].palette, brightness,
+                             LINEARBLEND);
+                }));
+  Serial.printf("  Plasma:  %u\n", benchmarkFrames([](uint16_t frame) {
+                  renderPlasma(target, NOISE_MAX_LEDS, frame * 10,
+                               palettes[currentPalette].palette, brightness,
+                               LINEARBLEND);
+                }));
+}
+
+void runBenchmarks() {
+  Serial.printf("\nBenchmarks with %d LEDs\n", NUM_LEDS);
+  runShaderBenchmark();
+  runParticleBenchmark();
+  runInterpolationBenchmark();
+  runNoiseBenchmark();
+}
+#endif
@@ -0,0 +1,156 @@
+#include "noiseEffects.h"
+
+static uint8_t permutation[256];
+static int8_t gradients[256];
+static uint8_t fadeTable[256];  // quintic fade curve of the cell fraction
+static bool tablesReady = false;
+
+static uint8_t lowOctave[NOISE_MAX_LEDS];
+static uint8_t highOctave[NOISE_MAX_LEDS];
+static uint32_t lowOctaveTime = 0;
+static uint16_t lowOctaveCount = 0;
+
+static uint8_t heat[NOISE_MAX_LEDS];
+static uint32_t fireTime = 0;  // time the heat was last stepped to
+static bool fireStarted = false;
+
+// Fixed seed, so every node renders the same noise
+static void buildTables() {
+  uint32_t seed = 0x2545F491;
+  for (int i = 0; i < 256; i++) {
+    permutation[i] = i;
+  }
+  for (int i = 255; i > 0; i--) {
+    seed = seed * 1664525 + 1013904223;
+    uint8_t j = (seed >> 16) % (i + 1);
+    uint8_t swap = permutation[i];
+    permutation[i] = permutation[j];
+    permutation[j] = swap;
+  }
+  for (int i = 0; i < 256; i++) {
+    seed = seed * 1664525 + 1013904223;
+    gradients[i] = (int)((seed >> 24) % 255) - 127;
+  }
+  for (int i = 0; i < 256; i++) {
+    float t = i / 256.0;
+    fadeTable[i] = t * t * t * (t * (t * 6 - 15) + 10) * 255 + 0.5;
+  }
+  tablesReady = true;
+}
+
+static inline int8_t gradientAt(uint32_t cell) {
+  return gradients[permutation[cell & 0xff]];
+}
+
+// One octave of noise, start and step are in 8.8 fixed point. Gradients are
+// only looked up when a pixel crosses into the next cell.
+static void renderOctave(uint8_t *octave, uint16_t count, uint32_t start,
+                         uint16_t step) {
+  uint32_t cell = start >> 8;
+  uint16_t fraction = start & 0xff;
+  int8_t g0 = gradientAt(cell);
+  int8_t g1 = gradientAt(cell + 1);
+
+  for (uint16_t i = 0; i < count; i++) {
+    int32_t a = g0 * (int32_t)fraction;
+    int32_t b = g1 * ((int32_t)fraction - 256);
+    int32_t value = a + (((b - a) * fadeTable[fraction]) >> 8);
+    octave[i] = constrain((value >> 6) + 128, 0, 255);
+
+    fraction += step;
+    while (fraction >= 256) {
+      fraction -= 256;
+      cell++;
+      g0 = g1;
+      g1 = gradientAt(cell + 1);
+    }
+  }
+}
+
+void renderNoise(CRGB *target, uint16_t count, uint32_t time,
+                 const CRGBPalette16 &palette, uint8_t brightness,
+                 TBlendType blendType) {
+  if (!tablesReady) buildTables();
+  count = min(count, (uint16_t)NOISE_MAX_LEDS);
+
+  // Cells of 32 pixels moving one cell per second, slow enough to reuse the
+  // octave of the previous frames
+  if (count != lowOctaveCount || time - lowOctaveTime >= NOISE_REUSE_TIME) {
+    renderOctave(lowOctave, count, time / 4, 8);
+    lowOctaveTime = time;
+    lowOctaveCount = count;
+  }
+  // Cells of 8 pixels moving four cells per second
+  renderOctave(highOctave, count, time, 32);
+
+  for (uint16_t i = 0; i < count; i++) {
+    // Three quarters slow octave, one quarter detail, never wraps around
+    uint8_t index = scale8(lowOctave[i], 191) + (highOctave[i] >> 2);
+    target[i] = ColorFromPalette(palette, index, brightness, blendType);
+  }
+}
+
+// One step of Fire2012
+static void stepFire(uint16_t count) {
+  // Cool down every cell a little
+  uint8_t cooling = (FIRE_COOLING * 10) / count + 2;
+  for (uint16_t i = 0; i < count; i++) {
+    heat[i] = qsub8(heat[i], random8(cooling));
+  }
+
+  // Heat drifts up and diffuses, in place from the top down
+  for (uint16_t k = count - 1; k >= 2; k--) {
+    heat[k] = (heat[k - 1] + heat[k - 2] + heat[k - 2]) / 3;
+  }
+
+  // Randomly ignite new sparks near the bottom
+  if (random8() < FIRE_SPARKING) {
+    uint8_t y = random8(7);
+    heat[y] = qadd8(heat[y], random8(160, 255));
+  }
+}
+
+void renderFire(CRGB *target, uint16_t count, uint32_t time,
+                const CRGBPalette16 &palette, uint8_t brightness,
+                TBlendType blendType) {
+  count = min(count, (uint16_t)NOISE_MAX_LEDS);
+
+  // Steps by elapsed time, so the speed does not follow the call rate. The
+  // remainder carries over to the next call, after a pause or a jump of the
+  // clock the fire only catches up FIRE_MAX_STEPS.
+  if (!fireStarted || (int32_t)(time - fireTime) < 0) {
+    fireTime = time;
+    fireStarted = true;
+  }
+  uint32_t steps = (time - fireTime) / FIRE_STEP_TIME;
+  if (steps > FIRE_MAX_STEPS) {
+    steps = FIRE_MAX_STEPS;
+    fireTime = time;
+  } else {
+    fireTime += steps * FIRE_STEP_TIME;
+  }
+  while (steps-- > 0) stepFire(count);
+
+  for (uint16_t j = 0; j < count; j++) {
+    target[j] =
+        ColorFromPalette(palette, scale8(heat[j], 240), brightness, blendType);
+  }
+}
+
+void renderPlasma(CRGB *target, uint16_t count, uint32_t time,
+                  const CRGBPalette16 &palette, uint8_t brightness,
+                  TBlendType blendType) {
+  // Phases in 8.8 fixed point, advanced per pixel instead of multiplied
+  uint16_t phase1 = time * 20;
+  uint16_t phase2 = -(time * 13);
+  uint16_t phase3 = time * 7;
+
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t index =
+        (sin8(phase1 >> 8) + sin8(phase2 >> 8) + sin8(phase3 >> 8)) / 3;
+    target[i] = ColorFromPalette(palette, index, brightness, blendType);
+    phase1 += 1100;
+    phase2 += 700;
+    phase3 += 300;
+  }
+}
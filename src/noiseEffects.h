@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// *************************
+// ** Noise, Fire and Plasma **
+// *************************
+// Table driven renderers for strips of up to NOISE_MAX_LEDS, colors come
+// from the given palette.
+
+#define NOISE_MAX_LEDS 1024
+
+// The slow noise octave is only recomputed after this many ms
+#define NOISE_REUSE_TIME 40
+
+// Fire2012 tuning, see https://github.com/FastLED/FastLED/tree/master/examples/Fire2012
+#define FIRE_COOLING 55
+#define FIRE_SPARKING 120
+// ms per simulation step, and the most steps one call catches up
+#define FIRE_STEP_TIME 10
+#define FIRE_MAX_STEPS 50
+
+// Two octaves of 1D gradient noise scrolling over the palette
+void renderNoise(CRGB *target, uint16_t count, uint32_t time,
+                 const CRGBPalette16 &palette, uint8_t brightness,
+                 TBlendType blendType);
+
+// Fire2012 heat diffusion, one step per FIRE_STEP_TIME since the last call
+void renderFire(CRGB *target, uint16_t count, uint32_t time,
+                const CRGBPalette16 &palette, uint8_t brightness,
+                TBlendType blendType);
+
+// Three moving sine waves
+void renderPlasma(CRGB *target, uint16_t count, uint32_t time,
+                  const CRGBPalette16 &palette, uint8_t brightness,
+                  TBlendType blendType);
@@ -0,0 +1,94 @@
+#include "particles.h"
+
+void useParticles(ParticlePool &pool, void (*owner)(), CRGB *target,
+                  uint16_t count, CRGB background) {
+  if (pool.owner == owner) return;
+
+  pool.owner = owner;
+  pool.count = 0;
+  pool.background = background;
+  for (uint16_t i = 0; i < count; i++) {
+    target[i] = background;
+  }
+}
+
+void releaseParticles(ParticlePool &pool) {
+  pool.owner = NULL;
+  pool.count = 0;
+}
+
+bool spawnParticle(ParticlePool &pool, int32_t pixel, int16_t velocity,
+                   CRGB color, uint8_t decay, uint8_t flags) {
+  if (pool.count == MAX_PARTICLES) return false;
+
+  uint8_t i = pool.count++;
+  pool.position[i] = pixel * 256;  // 8.8, pixel may be negative
+  pool.velocity[i] = velocity;
+  pool.color[i] = color;
+  pool.life[i] = 255;
+  pool.decay[i] = decay;
+  pool.flags[i] = flags;
+  return true;
+}
+
+static inline void moveParticle(ParticlePool &pool, uint8_t from, uint8_t to) {
+  pool.position[to] = pool.position[from];
+  pool.velocity[to] = pool.velocity[from];
+  pool.color[to] = pool.color[from];
+  pool.life[to] = pool.life[from];
+  pool.decay[to] = pool.decay[from];
+  pool.flags[to] = pool.flags[from];
+}
+
+void updateParticles(ParticlePool &pool, CRGB *target, uint16_t count) {
+  // Trail particles spawned in this pass are appended after alive and wait
+  // for the next frame
+  uint8_t alive = pool.count;
+  uint8_t kept = 0;
+
+  for (uint8_t i = 0; i < alive; i++) {
+    int32_t pixel = pool.position[i] >> 8;
+    bool onStrip = pixel >= 0 && pixel < count;
+
+    // Faded out last frame, give the pixel back
+    if (pool.life[i] == 0) {
+      if (onStrip) target[pixel] = pool.background;
+      continue;
+    }
+
+    if (pool.velocity[i] != 0) {
+      pool.position[i] += pool.velocity[i];
+      int32_t next = pool.position[i] >> 8;
+      if (next != pixel && onStrip) {
+        bool trailed = false;
+        if (pool.flags[i] & PARTICLE_TRAIL) {
+          trailed = spawnParticle(pool, pixel, 0, pool.color[i],
+                                  pool.trailDecay,
+                                  pool.flags[i] & PARTICLE_RANDOM_DECAY);
+          if (trailed) pool.life[pool.count - 1] = pool.life[i];
+        }
+        if (!trailed) target[pixel] = pool.background;
+      }
+      pixel = next;
+      onStrip = pixel >= 0 && pixel < count;
+      // Gone for good once it left the strip
+      if (pixel >= count || (pixel < 0 && pool.velocity[i] < 0)) continue;
+    }
+
+    if (onStrip) {
+      target[pixel] = blend(pool.background, pool.color[i], pool.life[i]);
+    }
+
+    if (!(pool.flags[i] & PARTICLE_RANDOM_DECAY) || random8() < 102) {
+      pool.life[i] = scale8(pool.life[i], 255 - pool.decay[i]);
+    }
+
+    if (kept != i) moveParticle(pool, i, kept);
+    kept++;
+  }
+
+  for (uint8_t i = alive; i < pool.count; i++) {
+    moveParticle(pool, i, kept++);
+  }
+  pool.count = kept;
+}
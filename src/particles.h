@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// *************************
+// ** Particle Engine **
+// *************************
+// Fixed size pool, structure of arrays, no heap. Particles own the pixel they
+// are drawn on and restore the background when they move away or die, so a
+// frame only touches pixels of live particles and never the whole strip.
+
+#define MAX_PARTICLES 96
+
+// Leaves a particle with pool.trailDecay behind on every pixel it moves off
+#define PARTICLE_TRAIL 0x01
+// Decay only in about 40% of the frames, for a flickering fade
+#define PARTICLE_RANDOM_DECAY 0x02
+
+typedef struct {
+  int32_t position[MAX_PARTICLES];  // pixel in 8.8 fixed point
+  int16_t velocity[MAX_PARTICLES];  // pixels per frame in 8.8 fixed point
+  CRGB color[MAX_PARTICLES];
+  uint8_t life[MAX_PARTICLES];   // 255 full color, 0 background
+  uint8_t decay[MAX_PARTICLES];  // life is scaled by 255 - decay each frame
+  uint8_t flags[MAX_PARTICLES];
+  uint8_t count;
+
+  CRGB background;
+  uint8_t trailDecay;
+  void (*owner)();  // effect that uses the pool
+} ParticlePool;
+
+// Hands the pool to an effect. If another effect used it before, the pool is
+// emptied and target is filled with the background once.
+void useParticles(ParticlePool &pool, void (*owner)(), CRGB *target,
+                  uint16_t count, CRGB background);
+
+void releaseParticles(ParticlePool &pool);
+
+// Returns false if the pool is full
+bool spawnParticle(ParticlePool &pool, int32_t pixel, int16_t velocity,
+                   CRGB color, uint8_t decay, uint8_t flags);
+
+// Moves, draws and fades all particles in one pass
+void updateParticles(ParticlePool &pool, CRGB *target, uint16_t count);
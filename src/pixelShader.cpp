@@ -0,0 +1,698 @@
+#include "pixelShader.h"
+
+#define SHADER_MAX_NODES 48
+#define SHADER_MAX_LOCALS 8
+#define SHADER_NAME_LENGTH 8
+
+// *************************
+// ** Bytecode **
+// *************************
+
+enum {
+  OP_CONST8,   // push next byte
+  OP_CONST32,  // push next 4 bytes
+  OP_LOAD,     // push register (next byte)
+  OP_STORE,    // pop into register (next byte)
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_AND,
+  OP_OR,
+  OP_XOR,
+  OP_SHL,
+  OP_SHR,
+  OP_LT,
+  OP_GT,
+  OP_LE,
+  OP_GE,
+  OP_EQ,
+  OP_NE,
+  OP_MIN,
+  OP_MAX,
+  OP_SCALE8,
+  OP_NEG,
+  OP_ABS,
+  OP_SIN8,
+  OP_COS8,
+  OP_TRI8,
+  OP_RAND8
+};
+
+// Registers, inputs first, then outputs, then locals and hoisted values
+enum {
+  REG_I,
+  REG_N,
+  REG_T,
+  REG_P0,
+  REG_PAL = REG_P0 + SHADER_PARAMS,
+  REG_BRI,
+  REG_R,
+  REG_G,
+  REG_B,
+  REG_FIRST_FREE
+};
+
+static inline uint8_t clamp8(int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// Arithmetic is done unsigned so overflow wraps instead of being undefined
+static inline void execute(const uint8_t *code, uint8_t length,
+                           int32_t *regs) {
+  int32_t stack[SHADER_MAX_STACK];
+  int32_t *sp = stack;
+  const uint8_t *pc = code;
+  const uint8_t *end = code + length;
+
+  while (pc < end) {
+    switch (*pc++) {
+      case OP_CONST8:
+        *sp++ = *pc++;
+        break;
+      case OP_CONST32:
+        memcpy(sp++, pc, 4);
+        pc += 4;
+        break;
+      case OP_LOAD:
+        *sp++ = regs[*pc++];
+        break;
+      case OP_STORE:
+        regs[*pc++] = *--sp;
+        break;
+      case OP_ADD:
+        sp--;
+        sp[-1] = (uint32_t)sp[-1] + (uint32_t)sp[0];
+        break;
+      case OP_SUB:
+        sp--;
+        sp[-1] = (uint32_t)sp[-1] - (uint32_t)sp[0];
+        break;
+      case OP_MUL:
+        sp--;
+        sp[-1] = (uint32_t)sp[-1] * (uint32_t)sp[0];
+        break;
+      case OP_DIV:
+        sp--;
+        if (sp[0] == 0) sp[-1] = 0;
+        else if (sp[0] == -1) sp[-1] = 0u - (uint32_t)sp[-1];
+        else sp[-1] /= sp[0];
+        break;
+      case OP_MOD:
+        sp--;
+        sp[-1] = (sp[0] == 0 || sp[0] == -1) ? 0 : sp[-1] % sp[0];
+        break;
+      case OP_AND:
+        sp--;
+        sp[-1] &= sp[0];
+        break;
+      case OP_OR:
+        sp--;
+        sp[-1] |= sp[0];
+        break;
+      case OP_XOR:
+        sp--;
+        sp[-1] ^= sp[0];
+        break;
+      case OP_SHL:
+        sp--;
+        sp[-1] = (uint32_t)sp[-1] << (sp[0] & 31);
+        break;
+      case OP_SHR:
+        sp--;
+        sp[-1] >>= (sp[0] & 31);
+        break;
+      case OP_LT:
+        sp--;
+        sp[-1] = sp[-1] < sp[0];
+        break;
+      case OP_GT:
+        sp--;
+        sp[-1] = sp[-1] > sp[0];
+        break;
+      case OP_LE:
+        sp--;
+        sp[-1] = sp[-1] <= sp[0];
+        break;
+      case OP_GE:
+        sp--;
+        sp[-1] = sp[-1] >= sp[0];
+        break;
+      case OP_EQ:
+        sp--;
+        sp[-1] = sp[-1] == sp[0];
+        break;
+      case OP_NE:
+        sp--;
+        sp[-1] = sp[-1] != sp[0];
+        break;
+      case OP_MIN:
+        sp--;
+        if (sp[0] < sp[-1]) sp[-1] = sp[0];
+        break;
+      case OP_MAX:
+        sp--;
+        if (sp[0] > sp[-1]) sp[-1] = sp[0];
+        break;
+      case OP_SCALE8:
+        sp--;
+        sp[-1] = scale8(sp[-1], sp[0]);
+        break;
+      case OP_NEG:
+        sp[-1] = 0u - (uint32_t)sp[-1];
+        break;
+      case OP_ABS:
+        if (sp[-1] < 0) sp[-1] = 0u - (uint32_t)sp[-1];
+        break;
+      case OP_SIN8:
+        sp[-1] = sin8(sp[-1]);
+        break;
+      case OP_COS8:
+        sp[-1] = cos8(sp[-1]);
+        break;
+      case OP_TRI8:
+        sp[-1] = triwave8(sp[-1]);
+        break;
+      case OP_RAND8:
+        *sp++ = random8();
+        break;
+    }
+  }
+}
+
+void runShader(const ShaderProgram &program, CRGB *target, uint16_t count,
+               uint32_t time, const CRGBPalette16 &palette, uint8_t brightness,
+               TBlendType blendType) {
+  int32_t regs[SHADER_MAX_REGS];
+  regs[REG_N] = count;
+  regs[REG_T] = time;
+  for (int i = 0; i < SHADER_PARAMS; i++) {
+    regs[REG_P0 + i] = program.params[i];
+  }
+  regs[REG_PAL] = 0;
+  regs[REG_BRI] = 255;
+  regs[REG_R] = 0;
+  regs[REG_G] = 0;
+  regs[REG_B] = 0;
+
+  execute(program.frameCode, program.frameLength, regs);
+
+  for (uint16_t i = 0; i < count; i++) {
+    regs[REG_I] = i;
+    execute(program.pixelCode, program.pixelLength, regs);
+    if (program.rgbOutput) {
+      target[i] = CRGB(clamp8(regs[REG_R]), clamp8(regs[REG_G]),
+                       clamp8(regs[REG_B]));
+    } else {
+      target[i] = ColorFromPalette(palette, regs[REG_PAL],
+                                   scale8(clamp8(regs[REG_BRI]), brightness),
+                                   blendType);
+    }
+  }
+}
+
+// *************************
+// ** Compiler **
+// *************************
+
+// What a node depends on. Nodes without any dependency are folded at compile
+// time, nodes with DEP_FRAME only are hoisted into the frame code.
+enum { DEP_FRAME = 1, DEP_PIXEL = 2 };
+
+// Token types, operators use their own character or one of these for two
+// character operators
+enum {
+  TOK_END = 0,
+  TOK_NUMBER = 'n',
+  TOK_NAME = 'a',
+  TOK_LE = 'L',
+  TOK_GE = 'G',
+  TOK_EQ = 'E',
+  TOK_NE = 'N',
+  TOK_SHL = 'l',
+  TOK_SHR = 'r'
+};
+
+typedef struct {
+  uint8_t op;
+  uint8_t deps;
+  int8_t a, b;    // child nodes, -1 if unused
+  int32_t value;  // constant value or register
+} ShaderNode;
+
+typedef struct {
+  char name[SHADER_NAME_LENGTH];
+  bool isConst;
+  uint8_t deps;
+  int32_t value;  // constant value or register
+} ShaderLocal;
+
+typedef struct {
+  uint8_t *code;
+  uint8_t length;
+  uint8_t depth;
+  uint8_t maxDepth;
+} ShaderEmitter;
+
+typedef struct {
+  const char *pos;
+  char token;
+  int32_t number;
+  char name[SHADER_NAME_LENGTH];
+
+  ShaderNode nodes[SHADER_MAX_NODES];
+  uint8_t nodeCount;
+  ShaderLocal locals[SHADER_MAX_LOCALS];
+  uint8_t localCount;
+  uint8_t nextReg;
+  uint8_t pixelWritten;  // outputs already assigned in pixel code
+  uint8_t depth;         // nesting of parens, calls and unary minus
+
+  ShaderEmitter frame;
+  ShaderEmitter pixel;
+  bool rgbOutput;
+
+  bool failed;
+  String error;
+} ShaderCompiler;
+
+typedef struct {
+  const char *name;
+  uint8_t op;
+  uint8_t args;
+} ShaderFunction;
+
+static const ShaderFunction shaderFunctions[] = {
+    {"sin8", OP_SIN8, 1},     {"cos8", OP_COS8, 1}, {"tri8", OP_TRI8, 1},
+    {"abs", OP_ABS, 1},       {"rand8", OP_RAND8, 0},
+    {"scale8", OP_SCALE8, 2}, {"min", OP_MIN, 2},   {"max", OP_MAX, 2}};
+
+typedef struct {
+  const char *name;
+  uint8_t reg;
+  uint8_t deps;
+} ShaderVariable;
+
+static const ShaderVariable shaderInputs[] = {
+    {"i", REG_I, DEP_PIXEL},        {"n", REG_N, DEP_FRAME},
+    {"t", REG_T, DEP_FRAME},        {"p0", REG_P0, DEP_FRAME},
+    {"p1", REG_P0 + 1, DEP_FRAME},  {"p2", REG_P0 + 2, DEP_FRAME},
+    {"p3", REG_P0 + 3, DEP_FRAME}};
+
+static const ShaderVariable shaderOutputs[] = {{"pal", REG_PAL, 0},
+                                               {"bri", REG_BRI, 0},
+                                               {"r", REG_R, 0},
+                                               {"g", REG_G, 0},
+                                               {"b", REG_B, 0}};
+
+static void fail(ShaderCompiler &c, const String &message) {
+  if (!c.failed) {
+    c.failed = true;
+    c.error = message;
+  }
+}
+
+static void nextToken(ShaderCompiler &c) {
+  while (isspace(*c.pos)) c.pos++;
+
+  char ch = *c.pos;
+  if (ch == '\0') {
+    c.token = TOK_END;
+  } else if (isdigit(ch)) {
+    char *end;
+    c.number = strtol(c.pos, &end, 0);
+    c.pos = end;
+    c.token = TOK_NUMBER;
+  } else if (isalpha(ch) || ch == '_') {
+    uint8_t length = 0;
+    while (isalnum(*c.pos) || *c.pos == '_') {
+      if (length == SHADER_NAME_LENGTH - 1) {
+        fail(c, "name too long");
+        c.token = TOK_END;
+        return;
+      }
+      c.name[length++] = *c.pos++;
+    }
+    c.name[length] = '\0';
+    c.token = TOK_NAME;
+  } else {
+    char next = c.pos[1];
+    c.pos++;
+    c.token = ch;
+    if (ch == '<' && next == '=') c.token = TOK_LE;
+    if (ch == '>' && next == '=') c.token = TOK_GE;
+    if (ch == '=' && next == '=') c.token = TOK_EQ;
+    if (ch == '!' && next == '=') c.token = TOK_NE;
+    if (ch == '<' && next == '<') c.token = TOK_SHL;
+    if (ch == '>' && next == '>') c.token = TOK_SHR;
+    if (c.token != ch) c.pos++;
+  }
+}
+
+static void expect(ShaderCompiler &c, char token, const char *what) {
+  if (c.token != token) {
+    fail(c, String("expected ") + what);
+    return;
+  }
+  nextToken(c);
+}
+
+static void emitByte(ShaderCompiler &c, ShaderEmitter &e, uint8_t byte) {
+  if (e.length == SHADER_MAX_CODE) {
+    fail(c, "program too long");
+    return;
+  }
+  e.code[e.length++] = byte;
+}
+
+// Emits an instruction and keeps track of the stack depth it needs
+static void emitOp(ShaderCompiler &c, ShaderEmitter &e, uint8_t op) {
+  emitByte(c, e, op);
+  if (op == OP_CONST8 || op == OP_CONST32 || op == OP_LOAD ||
+      op == OP_RAND8) {
+    e.depth++;
+  } else if (op < OP_NEG) {
+    e.depth--;  // store and binary operators
+  }
+  if (e.depth > e.maxDepth) e.maxDepth = e.depth;
+  if (e.maxDepth > SHADER_MAX_STACK) fail(c, "expression too deep");
+}
+
+static void emitConst(ShaderCompiler &c, ShaderEmitter &e, int32_t value) {
+  if (value >= 0 && value <= 255) {
+    emitOp(c, e, OP_CONST8);
+    emitByte(c, e, value);
+  } else {
+    emitOp(c, e, OP_CONST32);
+    uint8_t bytes[4];
+    memcpy(bytes, &value, 4);
+    for (int i = 0; i < 4; i++) emitByte(c, e, bytes[i]);
+  }
+}
+
+static void emitRegister(ShaderCompiler &c, ShaderEmitter &e, uint8_t op,
+                         uint8_t reg) {
+  emitOp(c, e, op);
+  emitByte(c, e, reg);
+}
+
+static uint8_t allocRegister(ShaderCompiler &c) {
+  if (c.nextReg == SHADER_MAX_REGS) {
+    fail(c, "too many values");
+    return REG_FIRST_FREE;
+  }
+  return c.nextReg++;
+}
+
+// Emits a whole subtree
+static void emitNode(ShaderCompiler &c, ShaderEmitter &e, int8_t index) {
+  ShaderNode &node = c.nodes[index];
+  if (node.op == OP_CONST32) {
+    emitConst(c, e, node.value);
+  } else if (node.op == OP_LOAD) {
+    emitRegister(c, e, OP_LOAD, node.value);
+  } else {
+    if (node.a >= 0) emitNode(c, e, node.a);
+    if (node.b >= 0) emitNode(c, e, node.b);
+    emitOp(c, e, node.op);
+  }
+}
+
+// Emits a subtree into the pixel code, moving every frame only subtree into
+// the frame code
+static void emitPixelNode(ShaderCompiler &c, int8_t index) {
+  ShaderNode &node = c.nodes[index];
+  bool isLeaf = node.op == OP_CONST32 || node.op == OP_LOAD;
+  if (node.deps == DEP_FRAME && !isLeaf) {
+    uint8_t reg = allocRegister(c);
+    emitNode(c, c.frame, index);
+    emitRegister(c, c.frame, OP_STORE, reg);
+    emitRegister(c, c.pixel, OP_LOAD, reg);
+  } else if (isLeaf) {
+    emitNode(c, c.pixel, index);
+  } else {
+    if (node.a >= 0) emitPixelNode(c, node.a);
+    if (node.b >= 0) emitPixelNode(c, node.b);
+    emitOp(c, c.pixel, node.op);
+  }
+}
+
+static int8_t newConst(ShaderCompiler &c, int32_t value);
+
+static int8_t newNode(ShaderCompiler &c, uint8_t op, int8_t a, int8_t b,
+                      int32_t value, uint8_t deps) {
+  if (c.failed) return 0;
+  if (c.nodeCount == SHADER_MAX_NODES) {
+    fail(c, "expression too long");
+    return 0;
+  }
+  if (a >= 0) deps |= c.nodes[a].deps;
+  if (b >= 0) deps |= c.nodes[b].deps;
+  if (op == OP_RAND8) deps |= DEP_PIXEL;
+
+  int8_t index = c.nodeCount++;
+  c.nodes[index] = {op, deps, a, b, value};
+
+  // Constant folding, run the subtree once right now
+  bool isLeaf = op == OP_CONST32 || op == OP_LOAD;
+  if (deps == 0 && !isLeaf) {
+    uint8_t code[16];
+    ShaderEmitter e = {code, 0, 0, 0};
+    emitNode(c, e, index);
+    emitRegister(c, e, OP_STORE, 0);
+    int32_t result = 0;
+    execute(code, e.length, &result);
+    c.nodeCount = index;
+    return newConst(c, result);
+  }
+  return index;
+}
+
+static int8_t newConst(ShaderCompiler &c, int32_t value) {
+  return newNode(c, OP_CONST32, -1, -1, value, 0);
+}
+
+static int8_t parseExpression(ShaderCompiler &c, uint8_t minPrecedence);
+
+static int8_t parseCall(ShaderCompiler &c, const ShaderFunction &function) {
+  int8_t args[2] = {-1, -1};
+  expect(c, '(', "(");
+  for (int i = 0; i < function.args; i++) {
+    if (i > 0) expect(c, ',', ",");
+    args[i] = parseExpression(c, 1);
+  }
+  expect(c, ')', ")");
+  return newNode(c, function.op, args[0], args[1], 0, 0);
+}
+
+static int8_t parseVariable(ShaderCompiler &c) {
+  for (const ShaderVariable &input : shaderInputs) {
+    if (strcmp(c.name, input.name) == 0) {
+      return newNode(c, OP_LOAD, -1, -1, input.reg, input.deps);
+    }
+  }
+  for (int i = 0; i < c.localCount; i++) {
+    ShaderLocal &local = c.locals[i];
+    if (strcmp(c.name, local.name) == 0) {
+      if (local.isConst) return newConst(c, local.value);
+      return newNode(c, OP_LOAD, -1, -1, local.value, local.deps);
+    }
+  }
+  fail(c, String("unknown variable ") + c.name);
+  return 0;
+}
+
+static int8_t parseUnary(ShaderCompiler &c);
+
+static int8_t parseValue(ShaderCompiler &c) {
+  if (c.token == '-') {
+    nextToken(c);
+    return newNode(c, OP_NEG, parseUnary(c), -1, 0, 0);
+  }
+  if (c.token == '(') {
+    nextToken(c);
+    int8_t node = parseExpression(c, 1);
+    expect(c, ')', ")");
+    return node;
+  }
+  if (c.token == TOK_NUMBER) {
+    int32_t value = c.number;
+    nextToken(c);
+    return newConst(c, value);
+  }
+  if (c.token == TOK_NAME) {
+    for (const ShaderFunction &function : shaderFunctions) {
+      if (strcmp(c.name, function.name) == 0) {
+        nextToken(c);
+        return parseCall(c, function);
+      }
+    }
+    int8_t node = parseVariable(c);
+    nextToken(c);
+    return node;
+  }
+  fail(c, "expected value");
+  return 0;
+}
+
+// Every nesting level recurses through here. The depth is checked before
+// recursing, so a deeply nested upload fails instead of overflowing the stack.
+static int8_t parseUnary(ShaderCompiler &c) {
+  if (c.failed) return 0;
+  if (c.depth == SHADER_MAX_STACK) {
+    fail(c, "expression too deep");
+    return 0;
+  }
+  c.depth++;
+  int8_t node = parseValue(c);
+  c.depth--;
+  return node;
+}
+
+// Same precedence as in C, 0 means the token is not a binary operator
+static uint8_t binaryOperator(char token, uint8_t &op) {
+  switch (token) {
+    case '|': op = OP_OR; return 1;
+    case '^': op = OP_XOR; return 2;
+    case '&': op = OP_AND; return 3;
+    case TOK_EQ: op = OP_EQ; return 4;
+    case TOK_NE: op = OP_NE; return 4;
+    case '<': op = OP_LT; return 5;
+    case '>': op = OP_GT; return 5;
+    case TOK_LE: op = OP_LE; return 5;
+    case TOK_GE: op = OP_GE; return 5;
+    case TOK_SHL: op = OP_SHL; return 6;
+    case TOK_SHR: op = OP_SHR; return 6;
+    case '+': op = OP_ADD; return 7;
+    case '-': op = OP_SUB; return 7;
+    case '*': op = OP_MUL; return 8;
+    case '/': op = OP_DIV; return 8;
+    case '%': op = OP_MOD; return 8;
+    default: return 0;
+  }
+}
+
+static int8_t parseExpression(ShaderCompiler &c, uint8_t minPrecedence) {
+  int8_t left = parseUnary(c);
+  while (!c.failed) {
+    uint8_t op;
+    uint8_t precedence = binaryOperator(c.token, op);
+    if (precedence == 0 || precedence < minPrecedence) break;
+    nextToken(c);
+    int8_t right = parseExpression(c, precedence + 1);
+    left = newNode(c, op, left, right, 0, 0);
+  }
+  return left;
+}
+
+static void assignOutput(ShaderCompiler &c, uint8_t reg, int8_t root) {
+  uint8_t bit = 1 << (reg - REG_PAL);
+  if ((c.nodes[root].deps & DEP_PIXEL) || (c.pixelWritten & bit)) {
+    emitPixelNode(c, root);
+    emitRegister(c, c.pixel, OP_STORE, reg);
+    c.pixelWritten |= bit;
+  } else {
+    emitNode(c, c.frame, root);
+    emitRegister(c, c.frame, OP_STORE, reg);
+  }
+  if (reg >= REG_R) c.rgbOutput = true;
+}
+
+// Every assignment to a local gets its own register, so a frame level value
+// can never be overwritten by a pixel level one
+static void assignLocal(ShaderCompiler &c, const char *name, int8_t root) {
+  ShaderLocal *local = NULL;
+  for (int i = 0; i < c.localCount; i++) {
+    if (strcmp(name, c.locals[i].name) == 0) local = &c.locals[i];
+  }
+  if (local == NULL) {
+    if (c.localCount == SHADER_MAX_LOCALS) {
+      fail(c, "too many variables");
+      return;
+    }
+    local = &c.locals[c.localCount++];
+    strcpy(local->name, name);
+  }
+
+  ShaderNode &node = c.nodes[root];
+  local->deps = node.deps;
+  local->isConst = node.op == OP_CONST32;
+  if (local->isConst) {
+    local->value = node.value;
+    return;
+  }
+
+  local->value = allocRegister(c);
+  if (node.deps & DEP_PIXEL) {
+    emitPixelNode(c, root);
+    emitRegister(c, c.pixel, OP_STORE, local->value);
+  } else {
+    emitNode(c, c.frame, root);
+    emitRegister(c, c.frame, OP_STORE, local->value);
+  }
+}
+
+static void parseStatement(ShaderCompiler &c) {
+  if (c.token != TOK_NAME) {
+    fail(c, "expected assignment");
+    return;
+  }
+  char target[SHADER_NAME_LENGTH];
+  strcpy(target, c.name);
+  nextToken(c);
+  expect(c, '=', "=");
+
+  c.nodeCount = 0;
+  int8_t root = parseExpression(c, 1);
+  if (c.token != TOK_END) expect(c, ';', ";");
+  if (c.failed) return;
+
+  for (const ShaderVariable &input : shaderInputs) {
+    if (strcmp(target, input.name) == 0) {
+      fail(c, String("cannot assign ") + target);
+      return;
+    }
+  }
+  for (const ShaderVariable &output : shaderOutputs) {
+    if (strcmp(target, output.name) == 0) {
+      assignOutput(c, output.reg, root);
+      return;
+    }
+  }
+  assignLocal(c, target, root);
+}
+
+bool compileShader(const char *source, ShaderProgram &program, String &error) {
+  ShaderCompiler c;
+  uint8_t frameCode[SHADER_MAX_CODE];
+  uint8_t pixelCode[SHADER_MAX_CODE];
+  c.pos = source;
+  c.nodeCount = 0;
+  c.localCount = 0;
+  c.nextReg = REG_FIRST_FREE;
+  c.pixelWritten = 0;
+  c.depth = 0;
+  c.frame = {frameCode, 0, 0, 0};
+  c.pixel = {pixelCode, 0, 0, 0};
+  c.rgbOutput = false;
+  c.failed = false;
+
+  nextToken(c);
+  if (c.token == TOK_END) fail(c, "empty program");
+  while (!c.failed && c.token != TOK_END) {
+    parseStatement(c);
+  }
+
+  if (c.failed) {
+    error = c.error;
+    return false;
+  }
+
+  memcpy(program.frameCode, frameCode, c.frame.length);
+  program.frameLength = c.frame.length;
+  memcpy(program.pixelCode, pixelCode, c.pixel.length);
+  program.pixelLength = c.pixel.length;
+  program.rgbOutput = c.rgbOutput;
+  return true;
+}
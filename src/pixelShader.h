@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// *************************
+// ** Pixel Shader VM **
+// *************************
+// Uploaded effects are written in a tiny expression language, e.g.
+//   s = sin8(t / 8); pal = i * p0 + s; bri = 255;
+// Inputs:  i (pixel index), n (pixel count), t (time in ms), p0..p3 (params)
+// Outputs: pal, bri (palette color) or r, g, b (plain rgb color)
+// Functions: sin8, cos8, tri8, abs, scale8, min, max, rand8
+//
+// Constant subexpressions are folded at compile time, and everything that only
+// depends on t, n or the params is hoisted into frameCode which runs once per
+// frame. pixelCode is what is left and runs once per pixel.
+
+#define SHADER_MAX_CODE 128
+#define SHADER_MAX_REGS 24
+#define SHADER_MAX_STACK 16
+#define SHADER_PARAMS 4
+
+typedef struct {
+  uint8_t frameCode[SHADER_MAX_CODE];
+  uint8_t frameLength;
+  uint8_t pixelCode[SHADER_MAX_CODE];
+  uint8_t pixelLength;
+  bool rgbOutput;
+  int32_t params[SHADER_PARAMS];
+} ShaderProgram;
+
+// Compile source into program. Returns false and sets error on failure,
+// program is left untouched in that case.
+bool compileShader(const char *source, ShaderProgram &program, String &error);
+
+// Run one frame of program into target
+void runShader(const ShaderProgram &program, CRGB *target, uint16_t count,
+               uint32_t time, const CRGBPalette16 &palette, uint8_t brightness,
+               TBlendType blendType);
@@ -0,0 +1,141 @@
+#include "sequencer.h"
+
+// Ends with the latest cue end, or 0 if the last cue has no duration
+static uint32_t sequenceLength(const Sequence &sequence) {
+  uint32_t length = 0;
+  for (int i = 0; i < sequence.count; i++) {
+    const Cue &cue = sequence.cues[i];
+    if (cue.duration == 0 && i == sequence.count - 1) return 0;
+    if (cue.offset + cue.duration > length) length = cue.offset + cue.duration;
+  }
+  return length;
+}
+
+const char *validateSequence(const Sequence &sequence) {
+  if (sequence.count == 0) return "no cues";
+  for (int i = 1; i < sequence.count; i++) {
+    if (sequence.cues[i].offset < sequence.cues[i - 1].offset) {
+      return "cues not in order";
+    }
+  }
+  if (sequence.loop && sequenceLength(sequence) == 0) {
+    return "last cue needs a duration to loop";
+  }
+  return NULL;
+}
+
+void startSequence(Sequence &sequence, uint32_t start) {
+  sequence.start = start;
+  sequence.length = sequenceLength(sequence);
+  sequence.current = -1;
+  sequence.pass = 0;
+  sequence.running = true;
+  sequence.finished = false;
+}
+
+void stopSequence(Sequence &sequence) {
+  sequence.running = false;
+  sequence.finished = false;
+}
+
+// Finds the pass and the latest due cue at now, index is -1 before the first
+// cue. position is not wrapped without loop. Returns false if the sequence is
+// not running or not started yet.
+static bool locate(const Sequence &sequence, uint32_t now, uint32_t &position,
+                   uint32_t &pass, int8_t &index) {
+  int32_t elapsed = now - sequence.start;
+  if (!sequence.running || elapsed < 0) return false;
+
+  position = elapsed;
+  pass = 0;
+  if (sequence.loop) {
+    pass = position / sequence.length;
+    position %= sequence.length;
+  }
+  index = -1;
+  while (index + 1 < sequence.count &&
+         sequence.cues[index + 1].offset <= position) {
+    index++;
+  }
+  return true;
+}
+
+static bool hasEnded(const Sequence &sequence, uint32_t position) {
+  return !sequence.loop && sequence.length > 0 && position >= sequence.length;
+}
+
+// The cue after the one applied last, in next and nextPass. Returns whether it
+// is due at pass and index. Cues more than a pass behind are skipped, the cues
+// of the last full pass still set every field.
+static bool nextCue(const Sequence &sequence, uint32_t pass, int8_t index,
+                    int8_t &next, uint32_t &nextPass) {
+  next = sequence.current + 1;
+  nextPass = sequence.pass;
+  if (next >= sequence.count) {
+    if (!sequence.loop) return false;
+    next = 0;
+    nextPass++;
+  }
+  if (pass > 0 &&
+      (nextPass < pass - 1 || (nextPass == pass - 1 && next <= index))) {
+    next = index + 1;
+    nextPass = pass - 1;
+    if (next >= sequence.count) {
+      next = 0;
+      nextPass = pass;
+    }
+  }
+  return nextPass < pass || (nextPass == pass && next <= index);
+}
+
+bool isSequenceDue(const Sequence &sequence, uint32_t now) {
+  uint32_t position, pass;
+  int8_t index;
+  if (!locate(sequence, now, position, pass, index)) return false;
+  if (hasEnded(sequence, position)) return true;
+
+  int8_t next;
+  uint32_t nextPass;
+  return nextCue(sequence, pass, index, next, nextPass);
+}
+
+const Cue *updateSequence(Sequence &sequence, uint32_t now, uint8_t &level) {
+  level = sequence.finished ? 0 : 255;
+  uint32_t position, pass;
+  int8_t index;
+  if (!locate(sequence, now, position, pass, index)) return NULL;
+  if (hasEnded(sequence, position)) {
+    sequence.running = false;
+    sequence.finished = true;
+    level = 0;
+    return NULL;
+  }
+
+  // Fade in after the latest cue starts and out before its duration ends
+  if (index >= 0) {
+    const Cue &cue = sequence.cues[index];
+    uint32_t elapsed = position - cue.offset;
+    if (cue.duration > 0 && elapsed >= cue.duration) {
+      level = 0;
+    } else if (cue.transition == TRANSITION_FADE && cue.transitionTime > 0) {
+      if (elapsed < cue.transitionTime) {
+        level = elapsed * 255 / cue.transitionTime;
+      }
+      uint32_t remaining = cue.duration - elapsed;
+      if (cue.duration > 0 && remaining < cue.transitionTime &&
+          remaining * 255 / cue.transitionTime < level) {
+        level = remaining * 255 / cue.transitionTime;
+      }
+    }
+  }
+
+  // A cue fires once per pass. Cues a slow frame or a start in the past
+  // skipped are returned one per call, in order, since each may set only some
+  // fields.
+  int8_t next;
+  uint32_t nextPass;
+  if (!nextCue(sequence, pass, index, next, nextPass)) return NULL;
+  sequence.current = next;
+  sequence.pass = nextPass;
+  return &sequence.cues[next];
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// *************************
+// ** Sequencer **
+// *************************
+// A cue list that switches mode, effect, palette and color at fixed offsets
+// from the sequence start. The sequencer does not read a clock itself, the
+// caller passes the time in, so a simulated clock gives deterministic runs.
+// It does not depend on Arduino either and is tested on the host, see
+// test/test_sequencer.
+
+#define MAX_CUES 32
+
+enum { TRANSITION_CUT, TRANSITION_FADE };
+
+typedef struct {
+  uint32_t offset;  // ms from the sequence start, ascending
+  int8_t mode;      // -1 keeps the current mode
+  int8_t effect;    // -1 keeps the current effect
+  int8_t palette;   // -1 keeps the current palette
+  bool hasColor;
+  long color;
+  uint8_t transition;
+  uint16_t transitionTime;  // ms of fade in, and fade out if duration is set
+  uint32_t duration;        // ms until dark, 0 lasts until the next cue
+} Cue;
+
+typedef struct {
+  Cue cues[MAX_CUES];
+  uint8_t count;
+  bool loop;
+
+  bool running;
+  bool finished;    // ran to its end, the output stays dark until a restart
+  uint32_t start;   // clock time of offset 0
+  uint32_t length;  // 0 holds the last cue forever
+  int8_t current;   // cue applied last, -1 for none
+  uint32_t pass;    // loop count of the cue applied last
+} Sequence;
+
+// Checks the cue list, returns why it can not be started or NULL
+const char *validateSequence(const Sequence &sequence);
+
+void startSequence(Sequence &sequence, uint32_t start);
+
+// Stops the sequence, the output goes back to full level
+void stopSequence(Sequence &sequence);
+
+// Advances to now, call every frame until it returns NULL. Returns the due
+// cues in order, one per call, then NULL. level is the output level of the
+// transition, 0 once a sequence without loop has finished.
+const Cue *updateSequence(Sequence &sequence, uint32_t now, uint8_t &level);
+
+// True if updateSequence has a cue to return at now or the sequence ends, so
+// the wait between frames can stop early
+bool isSequenceDue(const Sequence &sequence, uint32_t now);
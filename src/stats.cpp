@@ -0,0 +1,46 @@
+#include "stats.h"
+
+LatencyHistogram requestLatency;
+LatencyHistogram frameTime;
+
+// Values below 4 get a bucket each, above that the two bits after the
+// highest set bit pick one of four buckets per power of two
+static uint8_t bucketIndex(uint32_t value) {
+  if (value < STATS_SUB_BUCKETS) return value;
+  uint8_t msb = 31 - __builtin_clz(value);
+  uint8_t sub = (value >> (msb - 2)) & (STATS_SUB_BUCKETS - 1);
+  return (msb - 1) * STATS_SUB_BUCKETS + sub;
+}
+
+static uint32_t bucketUpperBound(uint8_t index) {
+  if (index < STATS_SUB_BUCKETS) return index;
+  uint8_t msb = index / STATS_SUB_BUCKETS + 1;
+  uint8_t sub = index % STATS_SUB_BUCKETS;
+  uint32_t lower = (uint32_t)(STATS_SUB_BUCKETS + sub) << (msb - 2);
+  return lower + ((uint32_t)1 << (msb - 2)) - 1;
+}
+
+void recordLatency(LatencyHistogram &histogram, uint32_t duration) {
+  histogram.buckets[bucketIndex(duration)]++;
+  histogram.count++;
+  if (duration > histogram.max) histogram.max = duration;
+}
+
+uint32_t latencyPercentile(const LatencyHistogram &histogram, uint8_t percent) {
+  if (histogram.count == 0) return 0;
+
+  uint32_t target = ((uint64_t)histogram.count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (int i = 0; i < STATS_BUCKETS; i++) {
+    seen += histogram.buckets[i];
+    if (seen >= target) {
+      uint32_t upper = bucketUpperBound(i);
+      return upper < histogram.max ? upper : histogram.max;
+    }
+  }
+  return histogram.max;
+}
+
+void resetLatency(LatencyHistogram &histogram) {
+  memset(&histogram, 0, sizeof(histogram));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+// *************************
+// ** Runtime Statistics **
+// *************************
+// Latency histograms for requests and frames, four buckets per power of two
+// so percentiles are accurate to about 20%.
+
+#define STATS_SUB_BUCKETS 4
+#define STATS_BUCKETS (32 * STATS_SUB_BUCKETS)
+
+typedef struct {
+  uint32_t buckets[STATS_BUCKETS];
+  uint32_t count;
+  uint32_t max;  // in us
+} LatencyHistogram;
+
+extern LatencyHistogram requestLatency;
+// Render and show() of one frame, without the wait for the next one
+extern LatencyHistogram frameTime;
+
+void recordLatency(LatencyHistogram &histogram, uint32_t duration);
+
+// Upper bound of the bucket holding the given percentile, in us
+uint32_t latencyPercentile(const LatencyHistogram &histogram, uint8_t percent);
+
+void resetLatency(LatencyHistogram &histogram);
+
+// Records the time from construction to destruction, put it at the top of a
+// request handler
+class LatencyTimer {
+ public:
+  LatencyTimer(LatencyHistogram &histogram)
+      : histogram(histogram), start(micros()) {}
+  ~LatencyTimer() { recordLatency(histogram, micros() - start); }
+
+ private:
+  LatencyHistogram &histogram;
+  uint32_t start;
+};
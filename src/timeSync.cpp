@@ -0,0 +1,209 @@
+#include "timeSync.h"
+
+#include <AsyncUDP.h>
+#include <WiFi.h>
+
+enum { SYNC_BEACON, SYNC_REQUEST, SYNC_RESPONSE };
+
+// Beacon flag of a node that may lead, see candidate
+#define SYNC_CANDIDATE 0x01
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;
+  uint8_t flags;
+  uint32_t t0;  // request sent, follower clock
+  uint32_t t1;  // request received, leader network clock
+  uint32_t t2;  // response sent, leader network clock
+} SyncPacket;
+
+typedef struct {
+  uint32_t ip;
+  uint32_t lastSeen;
+  bool candidate;
+} SyncPeer;
+
+typedef struct {
+  int32_t offset;
+  uint32_t rtt;
+} SyncSample;
+
+static AsyncUDP udp;
+
+// Peers and samples are added on the UDP task and read, or reset when the
+// leader changes, on the sync task, all under syncMutex
+static SemaphoreHandle_t syncMutex;
+static SyncPeer peers[SYNC_MAX_PEERS];
+static SyncSample samples[SYNC_SAMPLES];
+static uint8_t sampleCount = 0;
+static uint8_t nextSample = 0;
+
+// A node may only lead once it listened for SYNC_PEER_TIMEOUT after boot and,
+// if there was a leader, took over its clock. A node that boots into a
+// running network then never pulls the shared clock back to its own millis().
+static uint32_t syncStart = 0;
+static volatile bool candidate = false;
+
+static volatile int32_t offset = 0;
+static volatile uint32_t offsetRtt = 0;
+static volatile uint32_t ownIp = 0;
+static volatile uint32_t leaderIp = 0;
+static volatile uint32_t pendingRequest = 0;  // t0 of the last request
+
+// IP as number in host order, so the lowest address wins the election
+static uint32_t ipValue(const IPAddress &ip) {
+  return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) |
+         ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+static bool isPeerAlive(const SyncPeer &peer, uint32_t now) {
+  return peer.ip != 0 && now - peer.lastSeen < SYNC_PEER_TIMEOUT;
+}
+
+uint32_t networkMillis() { return millis() + offset; }
+
+TimeSyncStatus getTimeSyncStatus() {
+  TimeSyncStatus status;
+  status.isLeader = leaderIp != 0 && leaderIp == ownIp;
+  status.leaderIp = leaderIp;
+  status.offset = offset;
+  status.rtt = offsetRtt;
+  status.peers = 0;
+  uint32_t now = millis();
+  xSemaphoreTake(syncMutex, portMAX_DELAY);
+  for (int i = 0; i < SYNC_MAX_PEERS; i++) {
+    if (isPeerAlive(peers[i], now)) status.peers++;
+  }
+  xSemaphoreGive(syncMutex);
+  return status;
+}
+
+// Call with syncMutex held
+static void rememberPeer(uint32_t ip, bool isCandidate) {
+  uint32_t now = millis();
+  uint8_t oldest = 0;
+  for (int i = 0; i < SYNC_MAX_PEERS; i++) {
+    if (peers[i].ip == ip) {
+      peers[i].lastSeen = now;
+      peers[i].candidate = isCandidate;
+      return;
+    }
+    if (now - peers[i].lastSeen > now - peers[oldest].lastSeen) oldest = i;
+  }
+  peers[oldest] = {ip, now, isCandidate};
+}
+
+// Use the offset of the sample with the lowest round trip time, its error is
+// at most half of that. Call with syncMutex held.
+static void addSample(int32_t sampleOffset, uint32_t rtt) {
+  samples[nextSample] = {sampleOffset, rtt};
+  nextSample = (nextSample + 1) % SYNC_SAMPLES;
+  if (sampleCount < SYNC_SAMPLES) sampleCount++;
+
+  uint8_t best = 0;
+  for (int i = 1; i < sampleCount; i++) {
+    if (samples[i].rtt < samples[best].rtt) best = i;
+  }
+  offset = samples[best].offset;
+  offsetRtt = samples[best].rtt;
+}
+
+static void onSyncPacket(AsyncUDPPacket &packet) {
+  if (packet.length() != sizeof(SyncPacket)) return;
+
+  SyncPacket message;
+  memcpy(&message, packet.data(), sizeof(message));
+  uint32_t sender = ipValue(packet.remoteIP());
+
+  switch (message.type) {
+    case SYNC_BEACON:
+      if (sender != ownIp) {
+        xSemaphoreTake(syncMutex, portMAX_DELAY);
+        rememberPeer(sender, message.flags & SYNC_CANDIDATE);
+        xSemaphoreGive(syncMutex);
+      }
+      break;
+
+    case SYNC_REQUEST:
+      message.type = SYNC_RESPONSE;
+      message.t1 = networkMillis();
+      message.t2 = networkMillis();
+      udp.writeTo((uint8_t *)&message, sizeof(message), packet.remoteIP(),
+                  SYNC_PORT);
+      break;
+
+    case SYNC_RESPONSE: {
+      uint32_t t3 = millis();
+      int32_t sampleOffset =
+          ((int32_t)(message.t1 - message.t0) + (int32_t)(message.t2 - t3)) /
+          2;
+      uint32_t rtt = (t3 - message.t0) - (message.t2 - message.t1);
+      // Drop late answers to older requests and answers of an old leader
+      xSemaphoreTake(syncMutex, portMAX_DELAY);
+      if (message.t0 == pendingRequest && sender == leaderIp) {
+        addSample(sampleOffset, rtt);
+      }
+      xSemaphoreGive(syncMutex);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+static void timeSyncTask(void *parameter) {
+  SyncPacket message = {};
+  for (;;) {
+    ownIp = ipValue(WiFi.localIP());
+    message.type = SYNC_BEACON;
+    message.flags = candidate ? SYNC_CANDIDATE : 0;
+    udp.broadcastTo((uint8_t *)&message, sizeof(message), SYNC_PORT);
+
+    // Elect the lowest address among the candidates. A new leader keeps its
+    // offset, so the shared clock does not jump when the leader changes.
+    uint32_t now = millis();
+    uint32_t leader = 0;
+    xSemaphoreTake(syncMutex, portMAX_DELAY);
+    for (int i = 0; i < SYNC_MAX_PEERS; i++) {
+      if (isPeerAlive(peers[i], now) && peers[i].candidate &&
+          (leader == 0 || peers[i].ip < leader)) {
+        leader = peers[i].ip;
+      }
+    }
+    // Without a candidate around there is no shared clock yet to take over
+    if (!candidate && now - syncStart >= SYNC_PEER_TIMEOUT &&
+        (leader == 0 || (leader == leaderIp && sampleCount > 0))) {
+      candidate = true;
+    }
+    if (candidate && (leader == 0 || ownIp < leader)) leader = ownIp;
+
+    if (leader != leaderIp) {
+      leaderIp = leader;
+      sampleCount = 0;
+      nextSample = 0;
+    }
+    if (leader != 0 && leader != ownIp) {
+      message.type = SYNC_REQUEST;
+      message.t0 = millis();
+      pendingRequest = message.t0;
+    }
+    xSemaphoreGive(syncMutex);
+
+    if (message.type == SYNC_REQUEST) {
+      udp.writeTo((uint8_t *)&message, sizeof(message),
+                  IPAddress(leader >> 24, leader >> 16, leader >> 8, leader),
+                  SYNC_PORT);
+    }
+
+    vTaskDelay(SYNC_INTERVAL / portTICK_PERIOD_MS);
+  }
+}
+
+void beginTimeSync() {
+  syncStart = millis();
+  syncMutex = xSemaphoreCreateMutex();
+  if (udp.listen(SYNC_PORT)) {
+    udp.onPacket(onSyncPacket);
+  }
+  xTaskCreate(timeSyncTask, "timeSync", 2048, NULL, 1, NULL);
+}
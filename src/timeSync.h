@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+// *************************
+// ** Network Time Sync **
+// *************************
+// Every node broadcasts a beacon on SYNC_PORT. The candidate with the lowest
+// IP address heard within SYNC_PEER_TIMEOUT is the leader. All other nodes ask
+// the leader for its clock, NTP style, and keep the offset of the sample with
+// the lowest round trip time. Effects that take their time from
+// networkMillis() then run in lockstep on all nodes.
+//
+// A node becomes a candidate SYNC_PEER_TIMEOUT after boot, once it follows
+// the current leader, so a new node with a lower address takes over the
+// running clock instead of restarting it.
+
+#define SYNC_PORT 4210
+#define SYNC_INTERVAL 1000
+#define SYNC_PEER_TIMEOUT 3500
+#define SYNC_MAX_PEERS 8
+#define SYNC_SAMPLES 8
+
+typedef struct {
+  bool isLeader;
+  uint32_t leaderIp;  // 0 while there is no candidate yet
+  int32_t offset;  // networkMillis() - millis()
+  uint32_t rtt;    // round trip time of the sample in use
+  uint8_t peers;
+} TimeSyncStatus;
+
+// Start beacons and the sync task, call once WiFi is connected
+void beginTimeSync();
+
+// Shared clock in ms, same on all nodes up to half the round trip time
+uint32_t networkMillis();
+
+TimeSyncStatus getTimeSyncStatus();
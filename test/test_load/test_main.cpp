@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "stats.h"
+
+// *************************
+// ** Load Test **
+// *************************
+// Runs the firmware with loop() on its own thread and hammers the settings,
+// palette and effect handlers from LOAD_CLIENTS connections at once. Prints
+// request latency, frame time with and without load and heap growth, and
+// fails if frames miss their budget or the heap keeps growing.
+
+#define LOAD_PORT 18080
+#define LOAD_CLIENTS 4
+#define LOAD_REQUESTS 2500  // per client and round
+#define LOAD_ROUNDS 4
+#define LOAD_IDLE_TIME 1000
+
+// One frame at 100 fps, in us
+#define LOAD_FRAME_BUDGET 10000
+// The first two rounds may grow the heap, e.g. for Strings reaching their
+// final size and the allocator settling. Later rounds must not grow it by more
+// than this.
+#define LOAD_MAX_HEAP_GROWTH 4096
+
+static std::atomic<bool> rendering;
+static std::mutex clientMutex;
+static LatencyHistogram clientLatency;
+static uint32_t failedRequests;
+
+static const char *settingsBodies[] = {
+    "{\"currentMode\":0,\"currentPalette\":\"Lava\",\"currentStep\":3,"
+    "\"hasBlend\":true,\"brightness\":64,\"fps\":100}",
+    "{\"currentMode\":0,\"currentPalette\":\"Ocean\",\"currentStep\":5,"
+    "\"hasBlend\":false,\"brightness\":128,\"fps\":100}",
+    "{\"currentMode\":1,\"currentColor\":\"0x00FF00\",\"currentStep\":3,"
+    "\"hasBlend\":true,\"brightness\":32,\"fps\":100}"};
+
+static const char *customPaletteBody =
+    "[\"0xFF0000\",\"0x00FF00\",\"0x0000FF\",\"0xFFFF00\",\"0xFF00FF\","
+    "\"0x00FFFF\",\"0xFFFFFF\",\"0x000000\",\"0xFF0000\",\"0x00FF00\","
+    "\"0x0000FF\",\"0xFFFF00\",\"0xFF00FF\",\"0x00FFFF\",\"0xFFFFFF\","
+    "\"0x000000\"]";
+
+void setUp() {}
+
+void tearDown() {}
+
+// One request on a new connection. Returns the status code, -1 if the
+// connection failed.
+static int httpRequest(const char *method, const char *path, const char *body,
+                       String &response) {
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(LOAD_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, (sockaddr *)&address, sizeof(address)) < 0) {
+    close(client);
+    return -1;
+  }
+
+  char header[256];
+  int length = snprintf(header, sizeof(header),
+                        "%s %s HTTP/1.1\r\nHost: localhost\r\n"
+                        "Content-Type: application/json\r\n"
+                        "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                        method, path, body ? (unsigned)strlen(body) : 0);
+  send(client, header, length, MSG_NOSIGNAL);
+  if (body) send(client, body, strlen(body), MSG_NOSIGNAL);
+
+  String answer;
+  char buffer[1024];
+  ssize_t received;
+  while ((received = recv(client, buffer, sizeof(buffer) - 1, 0)) > 0) {
+    buffer[received] = 0;
+    answer += buffer;
+  }
+  close(client);
+
+  int bodyStart = answer.indexOf("\r\n\r\n");
+  response = bodyStart < 0 ? String() : answer.substring(bodyStart + 4);
+  return answer.startsWith("HTTP/1.1 ") ? answer.substring(9, 12).toInt()
+                                         : -1;
+}
+
+static void getStats(JsonDocument &stats) {
+  String response;
+  TEST_ASSERT_EQUAL(200, httpRequest("GET", "/stats", NULL, response));
+  TEST_ASSERT_FALSE(deserializeJson(stats, response.c_str()));
+}
+
+static void resetStats() {
+  String response;
+  TEST_ASSERT_EQUAL(200, httpRequest("DELETE", "/stats", NULL, response));
+}
+
+static void renderLoop() {
+  while (rendering) loop();
+}
+
+static void clientLoop(int client) {
+  String response;
+  for (int i = 0; i < LOAD_REQUESTS; i++) {
+    uint32_t start = micros();
+    int status;
+    switch ((client + i) % 5) {
+      case 0:
+        status = httpRequest("PATCH", "/settings", settingsBodies[i % 3],
+                             response);
+        break;
+      case 1:
+        status = httpRequest("GET", "/settings", NULL, response);
+        break;
+      case 2:
+        status = httpRequest("GET", "/palettes", NULL, response);
+        break;
+      case 3:
+        status = httpRequest("GET", "/effects", NULL, response);
+        break;
+      default:
+        status = httpRequest("PATCH", "/palettes/custom", customPaletteBody,
+                             response);
+        break;
+    }
+    uint32_t duration = micros() - start;
+
+    std::lock_guard<std::mutex> lock(clientMutex);
+    recordLatency(clientLatency, duration);
+    if (status != 200) failedRequests++;
+  }
+}
+
+static void printLatency(const char *name, uint32_t count, uint32_t p50,
+                         uint32_t p90, uint32_t p99, uint32_t max) {
+  printf("  %-22s count %6lu  p50 %6lu  p90 %6lu  p99 %6lu  max %6lu us\n",
+         name, (unsigned long)count, (unsigned long)p50, (unsigned long)p90,
+         (unsigned long)p99, (unsigned long)max);
+}
+
+// A histogram as reported by GET /stats
+static void printLatency(const char *name, JsonObject histogram) {
+  printLatency(name, histogram["count"], histogram["p50"], histogram["p90"],
+               histogram["p99"], histogram["max"]);
+}
+
+void test_handlers_under_load() {
+  char port[8];
+  snprintf(port, sizeof(port), "%d", LOAD_PORT);
+  setenv("HOST_HTTP_PORT", port, 1);
+  setup();
+  rendering = true;
+  std::thread render(renderLoop);
+
+  StaticJsonDocument<512> idle;
+  resetStats();
+  delay(LOAD_IDLE_TIME);
+  getStats(idle);
+
+  StaticJsonDocument<512> loaded;
+  uint32_t freeHeap[LOAD_ROUNDS];
+  for (int round = 0; round < LOAD_ROUNDS; round++) {
+    resetStats();
+    std::thread clients[LOAD_CLIENTS];
+    for (int i = 0; i < LOAD_CLIENTS; i++) {
+      clients[i] = std::thread(clientLoop, i);
+    }
+    for (std::thread &client : clients) client.join();
+    getStats(loaded);
+    freeHeap[round] = loaded["heap"]["free"];
+  }
+
+  rendering = false;
+  render.join();
+
+  int32_t growth = (int32_t)(freeHeap[1] - freeHeap[LOAD_ROUNDS - 1]);
+
+  printf("\n%d clients, %d requests each per round, %d rounds\n",
+         LOAD_CLIENTS, LOAD_REQUESTS, LOAD_ROUNDS);
+  printLatency("requests, client side", clientLatency.count,
+               latencyPercentile(clientLatency, 50),
+               latencyPercentile(clientLatency, 90),
+               latencyPercentile(clientLatency, 99), clientLatency.max);
+  printLatency("requests, handler", loaded["requests"]);
+  printLatency("frames, idle", idle["frames"]);
+  printLatency("frames, under load", loaded["frames"]);
+  printf("  heap growth since boot %ld bytes, after the second round %ld\n",
+         (long)loaded["heap"]["growth"], (long)growth);
+
+  TEST_ASSERT_EQUAL_UINT32(0, failedRequests);
+  TEST_ASSERT_LESS_THAN_UINT32(LOAD_FRAME_BUDGET,
+                               loaded["frames"]["p99"].as<uint32_t>());
+  TEST_ASSERT_LESS_OR_EQUAL_INT32(LOAD_MAX_HEAP_GROWTH, growth);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_handlers_under_load);
+  return UNITY_END();
+}
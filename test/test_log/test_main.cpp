@@ -0,0 +1,170 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+#include "logBuffer.h"
+
+// *************************
+// ** Log Ring Test **
+// *************************
+// LOG_PRODUCERS threads log numbered messages while the test reads the ring
+// in place of the drain task, which is never started.
+
+#define LOG_PRODUCERS 4
+#define LOG_TEST_ROUNDS (3 * LOG_SLOTS)  // messages per producer
+
+static std::atomic<uint32_t> consumed(0);
+
+void setUp() {}
+
+void tearDown() {}
+
+// Reads "<time> <level> producer <p> message <n>", returns false for other
+// lines
+static bool parseLine(const char *line, int &producer, int &number) {
+  unsigned long time;
+  char level[8];
+  return sscanf(line, "%lu %7s producer %d message %d", &time, level,
+                &producer, &number) == 4;
+}
+
+// Reads every message left in the ring, checks that each producer's messages
+// come in the order they were logged and counts them
+static int drain(int *next) {
+  char line[LOG_MESSAGE_LENGTH];
+  int count = 0;
+  while (readLogMessage(line)) {
+    int producer, number;
+    TEST_ASSERT_TRUE(parseLine(line, producer, number));
+    TEST_ASSERT_EQUAL(next[producer], number);
+    next[producer]++;
+    count++;
+    consumed++;
+  }
+  return count;
+}
+
+void test_wraps_around_without_drops() {
+  // Producers keep the ring at most half full, so nothing is dropped while it
+  // wraps around several times
+  uint32_t droppedBefore = droppedLogMessages();
+  uint32_t start = consumed;
+  std::thread producers[LOG_PRODUCERS];
+  for (int p = 0; p < LOG_PRODUCERS; p++) {
+    producers[p] = std::thread([p, start] {
+      for (int n = 0; n < LOG_TEST_ROUNDS; n++) {
+        while (n * LOG_PRODUCERS - (int)(consumed - start) >=
+               LOG_SLOTS / 2) {
+          std::this_thread::yield();
+        }
+        LOG_INFO("producer %d message %d", p, n);
+      }
+    });
+  }
+
+  int next[LOG_PRODUCERS] = {};
+  int total = 0;
+  while (total < LOG_PRODUCERS * LOG_TEST_ROUNDS) {
+    total += drain(next);
+  }
+  for (std::thread &producer : producers) producer.join();
+
+  TEST_ASSERT_EQUAL(LOG_PRODUCERS * LOG_TEST_ROUNDS, total);
+  TEST_ASSERT_EQUAL_UINT32(droppedBefore, droppedLogMessages());
+  for (int p = 0; p < LOG_PRODUCERS; p++) {
+    TEST_ASSERT_EQUAL(LOG_TEST_ROUNDS, next[p]);
+  }
+}
+
+void test_full_ring_drops_and_counts() {
+  // Nobody reads while the producers log, the ring keeps the first LOG_SLOTS
+  uint32_t droppedBefore = droppedLogMessages();
+  std::thread producers[LOG_PRODUCERS];
+  for (int p = 0; p < LOG_PRODUCERS; p++) {
+    producers[p] = std::thread([p] {
+      for (int n = 0; n < LOG_SLOTS; n++) {
+        LOG_INFO("producer %d message %d", p, n);
+      }
+    });
+  }
+  for (std::thread &producer : producers) producer.join();
+
+  TEST_ASSERT_EQUAL_UINT32((LOG_PRODUCERS - 1) * LOG_SLOTS,
+                           droppedLogMessages() - droppedBefore);
+  int next[LOG_PRODUCERS] = {};
+  TEST_ASSERT_EQUAL(LOG_SLOTS, drain(next));
+
+  // Room again after the drain
+  LOG_INFO("producer 0 message %d", next[0]);
+  TEST_ASSERT_EQUAL(1, drain(next));
+}
+
+void test_tail_keeps_last_lines_in_order() {
+  int next[LOG_PRODUCERS] = {};
+  for (int n = 0; n < LOG_TAIL + 5; n++) {
+    LOG_INFO("producer 0 message %d", n);
+  }
+  TEST_ASSERT_EQUAL(LOG_TAIL + 5, drain(next));
+
+  char lines[LOG_TAIL][LOG_MESSAGE_LENGTH];
+  TEST_ASSERT_EQUAL(LOG_TAIL, getLogTail(lines, LOG_TAIL));
+  for (int i = 0; i < LOG_TAIL; i++) {
+    int producer, number;
+    TEST_ASSERT_TRUE(parseLine(lines[i], producer, number));
+    TEST_ASSERT_EQUAL(5 + i, number);
+  }
+}
+
+void test_formats_in_the_consumer() {
+  // The string is copied when logged, not when formatted
+  char name[16] = "plasma";
+  LOG_WARN("shader %s rejected: %s (%5lu) %x%%", name, "too long",
+           (unsigned long)42, 255);
+  strcpy(name, "gone");
+  LOG_INFO("%d %ld %u", -7, -8L, 9u);
+
+  char line[LOG_MESSAGE_LENGTH];
+  TEST_ASSERT_TRUE(readLogMessage(line));
+  const char *message = strstr(line, "WARN ");
+  TEST_ASSERT_NOT_NULL(message);
+  TEST_ASSERT_EQUAL_STRING("WARN shader plasma rejected: too long (   42) ff%",
+                           message);
+  TEST_ASSERT_TRUE(readLogMessage(line));
+  TEST_ASSERT_NOT_NULL(strstr(line, "INFO -7 -8 9"));
+}
+
+void test_arguments_past_the_limit_end_the_message() {
+  LOG_INFO("%d %d %d %d %d end", 1, 2, 3, 4, 5);
+
+  char line[LOG_MESSAGE_LENGTH];
+  TEST_ASSERT_TRUE(readLogMessage(line));
+  TEST_ASSERT_EQUAL_STRING("INFO 1 2 3 4 ", strstr(line, "INFO "));
+}
+
+void test_long_strings_are_cut() {
+  char text[LOG_STRING_LENGTH * 2];
+  memset(text, 'a', sizeof(text) - 1);
+  text[sizeof(text) - 1] = '\0';
+  LOG_INFO("%s|%s|%d", text, "b", 1);
+
+  char line[LOG_MESSAGE_LENGTH];
+  TEST_ASSERT_TRUE(readLogMessage(line));
+  const char *message = strstr(line, "INFO ") + 5;
+  // The first string fills the slot, the second one is empty
+  TEST_ASSERT_EQUAL(LOG_STRING_LENGTH - 1 + 3, strlen(message));
+  TEST_ASSERT_EQUAL_STRING("||1", message + LOG_STRING_LENGTH - 1);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_wraps_around_without_drops);
+  RUN_TEST(test_full_ring_drops_and_counts);
+  RUN_TEST(test_tail_keeps_last_lines_in_order);
+  RUN_TEST(test_formats_in_the_consumer);
+  RUN_TEST(test_arguments_past_the_limit_end_the_message);
+  RUN_TEST(test_long_strings_are_cut);
+  return UNITY_END();
+}
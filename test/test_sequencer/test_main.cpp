@@ -0,0 +1,264 @@
+#include <string.h>
+#include <unity.h>
+
+#include "sequencer.h"
+
+// *************************
+// ** Sequencer Test **
+// *************************
+// Drives updateSequence with a simulated clock, every frame until it returns
+// NULL like loop() does.
+
+#define FRAME 10  // ms per frame at 100 fps
+
+static Sequence sequence;
+
+void setUp() { memset(&sequence, 0, sizeof(sequence)); }
+
+void tearDown() {}
+
+static Cue &addCue(uint32_t offset, int8_t effect) {
+  Cue &cue = sequence.cues[sequence.count++];
+  cue.offset = offset;
+  cue.mode = 2;
+  cue.effect = effect;
+  cue.palette = -1;
+  return cue;
+}
+
+// Output state the cues build up, as applyCue does in main.cpp
+typedef struct {
+  int8_t mode;
+  int8_t effect;
+  int8_t palette;
+  long color;
+} Output;
+
+static void applyCue(Output &output, const Cue &cue) {
+  if (cue.mode >= 0) output.mode = cue.mode;
+  if (cue.effect >= 0) output.effect = cue.effect;
+  if (cue.palette >= 0) output.palette = cue.palette;
+  if (cue.hasColor) output.color = cue.color;
+}
+
+// Applies every cue due at now, returns how many
+static int applyDue(Output &output, uint32_t now) {
+  int count = 0;
+  uint8_t level;
+  const Cue *cue;
+  while ((cue = updateSequence(sequence, now, level)) != NULL) {
+    applyCue(output, *cue);
+    count++;
+  }
+  return count;
+}
+
+// Runs frames from `from` up to, not including, `to` and records the effect
+// of every cue that fires, in order. Returns the number of cues fired.
+static int runFrames(uint32_t from, uint32_t to, int8_t *fired, int size) {
+  int count = 0;
+  uint8_t level;
+  for (uint32_t now = from; now < to; now += FRAME) {
+    const Cue *cue;
+    while ((cue = updateSequence(sequence, now, level)) != NULL) {
+      if (count < size) fired[count++] = cue->effect;
+    }
+  }
+  return count;
+}
+
+void test_cues_fire_once_per_pass() {
+  addCue(0, 1);
+  addCue(100, 2).duration = 100;
+  sequence.loop = true;
+  TEST_ASSERT_NULL(validateSequence(sequence));
+  startSequence(sequence, 1000);
+
+  int8_t fired[8];
+  TEST_ASSERT_EQUAL(0, runFrames(0, 1000, fired, 8));  // not started yet
+  TEST_ASSERT_EQUAL(6, runFrames(1000, 1600, fired, 8));
+  const int8_t expected[] = {1, 2, 1, 2, 1, 2};
+  for (int i = 0; i < 6; i++) TEST_ASSERT_EQUAL_INT8(expected[i], fired[i]);
+  TEST_ASSERT_EQUAL_UINT32(2, sequence.pass);
+  TEST_ASSERT_TRUE(sequence.running);
+}
+
+// Cues that set only some fields, -1 and no color keep the current value
+static void addPartialCues() {
+  addCue(0, 1).palette = 0;
+  Cue &palette = addCue(100, -1);
+  palette.mode = -1;
+  palette.palette = 3;
+  Cue &color = addCue(200, -1);
+  color.mode = -1;
+  color.hasColor = true;
+  color.color = 0x00ff00;
+  addCue(300, 4).mode = -1;
+}
+
+void test_skipped_cues_all_apply() {
+  addPartialCues();
+  startSequence(sequence, 0);
+
+  Output output = {0, 0, 0, 0};
+  TEST_ASSERT_EQUAL(1, applyDue(output, 0));
+  // A slow frame passes the palette cue at 100 and the color cue at 200
+  TEST_ASSERT_EQUAL(2, applyDue(output, 250));
+  TEST_ASSERT_EQUAL_INT8(1, output.effect);
+  TEST_ASSERT_EQUAL_INT8(3, output.palette);
+  TEST_ASSERT_EQUAL_HEX32(0x00ff00, output.color);
+  TEST_ASSERT_EQUAL(0, applyDue(output, 260));
+  TEST_ASSERT_EQUAL(1, applyDue(output, 300));
+  TEST_ASSERT_EQUAL_INT8(4, output.effect);
+  TEST_ASSERT_EQUAL_INT8(3, output.palette);
+  TEST_ASSERT_EQUAL_HEX32(0x00ff00, output.color);
+}
+
+void test_start_in_the_past_applies_all_due_cues() {
+  addPartialCues();
+  startSequence(sequence, 1000);
+
+  Output output = {0, 0, 0, 0};
+  TEST_ASSERT_EQUAL(3, applyDue(output, 1250));
+  TEST_ASSERT_EQUAL_INT8(2, output.mode);
+  TEST_ASSERT_EQUAL_INT8(1, output.effect);
+  TEST_ASSERT_EQUAL_INT8(3, output.palette);
+  TEST_ASSERT_EQUAL_HEX32(0x00ff00, output.color);
+}
+
+void test_late_loop_catches_up_within_one_pass() {
+  addPartialCues();
+  sequence.cues[3].duration = 100;
+  sequence.loop = true;
+  startSequence(sequence, 0);
+
+  // Ten passes late, only the cues of the last full pass up to now apply,
+  // from the one at 200 in pass 9 to the one at 100 in pass 10
+  Output output = {0, 0, 0, 0};
+  TEST_ASSERT_EQUAL(4, applyDue(output, 10 * 400 + 150));
+  TEST_ASSERT_EQUAL_UINT32(10, sequence.pass);
+  TEST_ASSERT_EQUAL_INT8(1, sequence.current);
+  TEST_ASSERT_EQUAL_INT8(1, output.effect);
+  TEST_ASSERT_EQUAL_INT8(3, output.palette);
+  TEST_ASSERT_EQUAL_HEX32(0x00ff00, output.color);
+}
+
+void test_due_check_ends_waits() {
+  addCue(0, 1);
+  addCue(100, 2).duration = 100;
+  startSequence(sequence, 0);
+
+  TEST_ASSERT_TRUE(isSequenceDue(sequence, 0));
+  Output output = {0, 0, 0, 0};
+  applyDue(output, 0);
+  TEST_ASSERT_FALSE(isSequenceDue(sequence, 99));
+  TEST_ASSERT_TRUE(isSequenceDue(sequence, 100));
+  applyDue(output, 100);
+  TEST_ASSERT_FALSE(isSequenceDue(sequence, 199));
+  // The end of the show is due as well, so it goes dark on time
+  TEST_ASSERT_TRUE(isSequenceDue(sequence, 200));
+  applyDue(output, 200);
+  TEST_ASSERT_FALSE(isSequenceDue(sequence, 300));
+}
+
+void test_fade_in_and_out() {
+  Cue &cue = addCue(0, 1);
+  cue.transition = TRANSITION_FADE;
+  cue.transitionTime = 100;
+  cue.duration = 1000;
+  startSequence(sequence, 0);
+
+  uint8_t level;
+  updateSequence(sequence, 0, level);
+  TEST_ASSERT_EQUAL_UINT8(0, level);
+  updateSequence(sequence, 50, level);
+  TEST_ASSERT_UINT8_WITHIN(1, 127, level);
+  updateSequence(sequence, 100, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+  updateSequence(sequence, 500, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+  updateSequence(sequence, 950, level);
+  TEST_ASSERT_UINT8_WITHIN(1, 127, level);
+  updateSequence(sequence, 990, level);
+  TEST_ASSERT_UINT8_WITHIN(1, 25, level);
+}
+
+void test_cut_keeps_full_level() {
+  addCue(0, 1).transitionTime = 100;
+  startSequence(sequence, 0);
+
+  uint8_t level;
+  updateSequence(sequence, 0, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+}
+
+void test_show_ends_dark() {
+  addCue(0, 1);
+  addCue(100, 2).duration = 100;
+  startSequence(sequence, 0);
+
+  uint8_t level;
+  int8_t fired[4];
+  TEST_ASSERT_EQUAL(2, runFrames(0, 200, fired, 4));
+  for (uint32_t now = 200; now < 2000; now += FRAME) {
+    TEST_ASSERT_NULL(updateSequence(sequence, now, level));
+    TEST_ASSERT_EQUAL_UINT8(0, level);
+  }
+  TEST_ASSERT_FALSE(sequence.running);
+  TEST_ASSERT_TRUE(sequence.finished);
+
+  // Stopping gives the output back
+  stopSequence(sequence);
+  updateSequence(sequence, 2000, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+  TEST_ASSERT_FALSE(sequence.finished);
+
+  // So does a restart
+  startSequence(sequence, 2000);
+  runFrames(2000, 2300, fired, 4);
+  startSequence(sequence, 3000);
+  updateSequence(sequence, 3000, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+}
+
+void test_last_cue_without_duration_holds() {
+  addCue(0, 1);
+  addCue(100, 2);
+  startSequence(sequence, 0);
+  TEST_ASSERT_EQUAL_UINT32(0, sequence.length);
+
+  uint8_t level;
+  int8_t fired[4];
+  TEST_ASSERT_EQUAL(2, runFrames(0, 100000, fired, 4));
+  updateSequence(sequence, 100000, level);
+  TEST_ASSERT_EQUAL_UINT8(255, level);
+  TEST_ASSERT_TRUE(sequence.running);
+}
+
+void test_validation() {
+  TEST_ASSERT_EQUAL_STRING("no cues", validateSequence(sequence));
+  addCue(100, 1);
+  addCue(0, 2);
+  TEST_ASSERT_EQUAL_STRING("cues not in order", validateSequence(sequence));
+  sequence.cues[1].offset = 200;
+  sequence.loop = true;
+  TEST_ASSERT_EQUAL_STRING("last cue needs a duration to loop",
+                           validateSequence(sequence));
+  sequence.cues[1].duration = 100;
+  TEST_ASSERT_NULL(validateSequence(sequence));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cues_fire_once_per_pass);
+  RUN_TEST(test_skipped_cues_all_apply);
+  RUN_TEST(test_start_in_the_past_applies_all_due_cues);
+  RUN_TEST(test_late_loop_catches_up_within_one_pass);
+  RUN_TEST(test_due_check_ends_waits);
+  RUN_TEST(test_fade_in_and_out);
+  RUN_TEST(test_cut_keeps_full_level);
+  RUN_TEST(test_show_ends_dark);
+  RUN_TEST(test_last_cue_without_duration_holds);
+  RUN_TEST(test_validation);
+  return UNITY_END();
+}
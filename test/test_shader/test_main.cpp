@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "pixelShader.h"
+
+// *************************
+// ** Pixel Shader Test **
+// *************************
+// Compiles programs and checks the pixels they draw. Most programs write r, g
+// and b, so the expected value of a channel is just the expression result
+// clamped to 0..255.
+
+#define PIXELS 8
+#define TIME 42
+
+static ShaderProgram program;
+static CRGB pixels[PIXELS];
+static const CRGBPalette16 palette(CRGB::Red);
+
+void setUp() {
+  memset(&program, 0, sizeof(program));
+  fill_solid(pixels, PIXELS, CRGB(0, 0, 0));
+}
+
+void tearDown() {}
+
+static void run(const char *source) {
+  String error;
+  TEST_ASSERT_TRUE_MESSAGE(compileShader(source, program, error),
+                           error.c_str());
+  runShader(program, pixels, PIXELS, TIME, palette, 255, NOBLEND);
+}
+
+static void assertRejected(const char *source, const char *message) {
+  String error;
+  TEST_ASSERT_FALSE(compileShader(source, program, error));
+  TEST_ASSERT_EQUAL_STRING(message, error.c_str());
+}
+
+void test_local_reassigned_from_frame_to_pixel() {
+  // The frame level value of x is still what g reads, the pixel level one
+  // what r reads
+  run("x = t; g = x; x = i * 2; r = x; b = x + t;");
+  for (int i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i * 2, pixels[i].r);
+    TEST_ASSERT_EQUAL_UINT8(TIME, pixels[i].g);
+    TEST_ASSERT_EQUAL_UINT8(i * 2 + TIME, pixels[i].b);
+  }
+}
+
+void test_local_reassigned_from_pixel_to_frame() {
+  run("x = i; r = x; x = t; g = x;");
+  for (int i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, pixels[i].r);
+    TEST_ASSERT_EQUAL_UINT8(TIME, pixels[i].g);
+  }
+}
+
+void test_output_assigned_in_frame_then_pixel_code() {
+  run("r = t; r = i + 1; g = 0;");
+  for (int i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i + 1, pixels[i].r);
+  }
+}
+
+void test_output_assigned_in_pixel_then_frame_code() {
+  // The later frame level value has to win over the pixel level one
+  run("r = i + 1; r = t; g = 0;");
+  for (int i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(TIME, pixels[i].r);
+  }
+}
+
+void test_palette_output() {
+  run("pal = 0; bri = 255;");
+  TEST_ASSERT_FALSE(program.rgbOutput);
+  TEST_ASSERT_EQUAL_UINT8(255, pixels[0].r);
+  TEST_ASSERT_EQUAL_UINT8(0, pixels[0].g);
+}
+
+// A folded program is a constant store into an output in the frame code
+static void assertFolded() {
+  TEST_ASSERT_EQUAL(0, program.pixelLength);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(7, program.frameLength);
+}
+
+void test_division_by_zero_folds() {
+  run("r = 5 / 0 + 1;");
+  assertFolded();
+  TEST_ASSERT_EQUAL_UINT8(1, pixels[0].r);
+}
+
+void test_modulo_by_zero_folds() {
+  run("r = 7 % 0 + 2;");
+  assertFolded();
+  TEST_ASSERT_EQUAL_UINT8(2, pixels[0].r);
+}
+
+void test_int_min_divided_by_minus_one_folds() {
+  // Wraps back to INT_MIN instead of trapping
+  run("r = (-2147483647 - 1) / -1 == -2147483647 - 1;");
+  assertFolded();
+  TEST_ASSERT_EQUAL_UINT8(1, pixels[0].r);
+  run("r = (-2147483647 - 1) % -1 + 3;");
+  assertFolded();
+  TEST_ASSERT_EQUAL_UINT8(3, pixels[0].r);
+}
+
+void test_division_edge_cases_at_run_time() {
+  // Same results when the operands are only known per pixel
+  run("m = i - 2147483647 - 1; r = i / (i - i) + 1; g = i % (i - i) + 2;"
+      "b = (m / (i - i - 1) == m) + (m % (i - i - 1) == 0);");
+  TEST_ASSERT_NOT_EQUAL(0, program.pixelLength);
+  TEST_ASSERT_EQUAL_UINT8(1, pixels[3].r);
+  TEST_ASSERT_EQUAL_UINT8(2, pixels[3].g);
+  TEST_ASSERT_EQUAL_UINT8(2, pixels[0].b);
+}
+
+void test_too_deep_is_rejected() {
+  char source[64] = "r = ";
+  for (int i = 0; i <= SHADER_MAX_STACK; i++) strcat(source, "(");
+  strcat(source, "i");
+  for (int i = 0; i <= SHADER_MAX_STACK; i++) strcat(source, ")");
+  assertRejected(source, "expression too deep");
+
+  char calls[160] = "r = ";
+  for (int i = 0; i <= SHADER_MAX_STACK; i++) strcat(calls, "sin8(");
+  strcat(calls, "i");
+  for (int i = 0; i <= SHADER_MAX_STACK; i++) strcat(calls, ")");
+  assertRejected(calls, "expression too deep");
+}
+
+void test_too_long_is_rejected() {
+  // More nodes than one statement may have
+  char expression[128] = "r = i";
+  for (int i = 0; i < 30; i++) strcat(expression, "+i");
+  assertRejected(expression, "expression too long");
+
+  // More pixel code than fits the program
+  char statements[512] = "";
+  for (int i = 0; i < 30; i++) {
+    char statement[24];
+    snprintf(statement, sizeof(statement), "r = i + %d;", i);
+    strcat(statements, statement);
+  }
+  assertRejected(statements, "program too long");
+}
+
+void test_rejected_program_is_left_untouched() {
+  run("r = i;");
+  ShaderProgram before = program;
+  assertRejected("r = (", "expected value");
+  TEST_ASSERT_EQUAL(0, memcmp(&before, &program, sizeof(program)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_local_reassigned_from_frame_to_pixel);
+  RUN_TEST(test_local_reassigned_from_pixel_to_frame);
+  RUN_TEST(test_output_assigned_in_frame_then_pixel_code);
+  RUN_TEST(test_output_assigned_in_pixel_then_frame_code);
+  RUN_TEST(test_palette_output);
+  RUN_TEST(test_division_by_zero_folds);
+  RUN_TEST(test_modulo_by_zero_folds);
+  RUN_TEST(test_int_min_divided_by_minus_one_folds);
+  RUN_TEST(test_division_edge_cases_at_run_time);
+  RUN_TEST(test_too_deep_is_rejected);
+  RUN_TEST(test_too_long_is_rejected);
+  RUN_TEST(test_rejected_program_is_left_untouched);
+  return UNITY_END();
+}
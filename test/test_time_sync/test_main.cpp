@@ -0,0 +1,128 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "timeSync.h"
+
+// *************************
+// ** Time Sync Test **
+// *************************
+// Runs SYNC_NODES nodes as processes on 127.0.0.1 to 127.0.0.x, each with its
+// own millis(). The lowest address boots last, into a running network, and
+// has to take over the shared clock without pulling it back. Every node
+// compares networkMillis() with the common system clock, so the reported skew
+// is measured, not derived from round trip times.
+
+#define SYNC_NODES 4
+#define SYNC_TEST_TIME 16000
+
+// Measured skew and backward jump of the shared clock allowed, in ms
+#define SYNC_MAX_SKEW 5
+#define SYNC_MAX_JUMP 5
+
+// Boot time of 127.0.0.(i + 1) in ms after the start of the test
+static const uint32_t nodeStart[SYNC_NODES] = {6000, 0, 700, 1400};
+
+typedef struct {
+  uint8_t node;
+  int32_t offset;    // networkMillis() - system clock at the end
+  int32_t backJump;  // largest step back of networkMillis()
+  uint32_t skewBound;
+  uint32_t leaderIp;
+} NodeReport;
+
+void setUp() {}
+
+void tearDown() {}
+
+static uint32_t systemMillis() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void sleepUntil(uint32_t time) {
+  while ((int32_t)(time - systemMillis()) > 0) usleep(500);
+}
+
+static void runNode(uint8_t node, uint32_t testStart, int reportPipe) {
+  sleepUntil(testStart + nodeStart[node]);
+  hostRestartClock();
+  WiFi.config(IPAddress(127, 0, 0, node + 1));
+  beginTimeSync();
+
+  NodeReport report = {node, 0, 0, 0, 0};
+  uint32_t previous = networkMillis();
+  while ((int32_t)(systemMillis() - testStart - SYNC_TEST_TIME) < 0) {
+    uint32_t now = networkMillis();
+    if ((int32_t)(previous - now) > report.backJump) {
+      report.backJump = previous - now;
+    }
+    previous = now;
+    usleep(1000);
+  }
+  report.offset = networkMillis() - systemMillis();
+  TimeSyncStatus status = getTimeSyncStatus();
+  report.skewBound = status.rtt / 2;
+  report.leaderIp = status.leaderIp;
+  write(reportPipe, &report, sizeof(report));
+}
+
+void test_nodes_share_clock() {
+  int reportPipe[2];
+  TEST_ASSERT_EQUAL(0, pipe(reportPipe));
+
+  // Forked before any thread runs, every node starts its own tasks
+  uint32_t testStart = systemMillis();
+  pid_t children[SYNC_NODES];
+  for (uint8_t node = 0; node < SYNC_NODES; node++) {
+    children[node] = fork();
+    if (children[node] == 0) {
+      close(reportPipe[0]);
+      runNode(node, testStart, reportPipe[1]);
+      _exit(0);
+    }
+  }
+  close(reportPipe[1]);
+
+  NodeReport reports[SYNC_NODES];
+  int count = 0;
+  while (count < SYNC_NODES &&
+         read(reportPipe[0], &reports[count], sizeof(NodeReport)) ==
+             sizeof(NodeReport)) {
+    count++;
+  }
+  close(reportPipe[0]);
+  for (pid_t child : children) waitpid(child, NULL, 0);
+  TEST_ASSERT_EQUAL(SYNC_NODES, count);
+
+  int32_t minOffset = reports[0].offset, maxOffset = reports[0].offset;
+  int32_t maxJump = 0;
+  printf("\n");
+  for (const NodeReport &report : reports) {
+    printf("  127.0.0.%d  boot %5lu ms  leader 127.0.0.%lu  skew bound %lu ms"
+           "  largest step back %ld ms\n",
+           report.node + 1, (unsigned long)nodeStart[report.node],
+           (unsigned long)(report.leaderIp & 0xff),
+           (unsigned long)report.skewBound, (long)report.backJump);
+    if (report.offset < minOffset) minOffset = report.offset;
+    if (report.offset > maxOffset) maxOffset = report.offset;
+    if (report.backJump > maxJump) maxJump = report.backJump;
+  }
+  printf("  measured skew %ld ms\n", (long)(maxOffset - minOffset));
+
+  for (const NodeReport &report : reports) {
+    TEST_ASSERT_EQUAL_UINT32(0x7f000001, report.leaderIp);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL_INT32(SYNC_MAX_SKEW, maxOffset - minOffset);
+  TEST_ASSERT_LESS_OR_EQUAL_INT32(SYNC_MAX_JUMP, maxJump);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_nodes_share_clock);
+  return UNITY_END();
+}